@@ -0,0 +1,255 @@
+#include "chip8.hpp"
+#include "framebuffer.hpp"
+#include "jit.hpp"
+#include "lockstep.hpp"
+#include "rom_library.hpp"
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// throughput benchmarks: single opcode handlers, instruction dispatch, and whole ROMs run
+// headlessly. MIPS = millions of emulated instructions per second of host time
+
+class Chip8Bench {
+public:
+    using Handler = void (Chip8::*)();
+
+    static void registerAll();
+
+private:
+    static constexpr unsigned kRomClockSpeed = 600000;     // 10000 instructions per frame
+    static constexpr unsigned kRomFrames = 60;
+    static constexpr std::size_t kLanes = 256;
+
+    static void setOperands(Chip8& chip8, std::uint16_t opcode) {
+        chip8.m_opcode = opcode;
+        chip8.mask = opcode & 0x000F;
+        chip8.byte = opcode & 0x00FF;
+        chip8.addr = opcode & 0x0FFF;
+        chip8.x    = (opcode & 0x0F00) >> 8;
+        chip8.y    = (opcode & 0x00F0) >> 4;
+    }
+
+    // one handler call per iteration with fixed operands, PC and I are put back every time
+    // so memory instructions keep hitting the same bytes
+    static void opcode(benchmark::State& st, Handler op, std::uint16_t opcode) {
+        Chip8 chip8;
+        for (int i = 0; i < 16; ++i)
+            chip8.m_state.V[i] = static_cast<std::uint8_t>(i * 37 + 11);
+        setOperands(chip8, opcode);
+
+        for (auto _ : st) {
+            chip8.m_state.pc = 0x200;
+            chip8.m_state.index = 0x300;
+            (chip8.*op)();
+            benchmark::DoNotOptimize(chip8.m_state);
+        }
+        st.SetItemsProcessed(st.iterations());
+    }
+
+    // DRW with the sprite moving across the screen, so every shift amount and the clipped
+    // right edge get their share
+    static void drw(benchmark::State& st) {
+        Chip8 chip8;
+        setOperands(chip8, 0xD125);
+        chip8.m_state.index = 0x000;            // font glyph for 0
+        std::uint8_t col = 0;
+
+        for (auto _ : st) {
+            chip8.m_state.V[1] = col++;
+            chip8.m_state.V[2] = col >> 3;
+            chip8.DRW();
+            benchmark::DoNotOptimize(chip8.m_state.display);
+        }
+        st.SetItemsProcessed(st.iterations());
+    }
+
+    // the whole screen to ARGB with the kernel Framebuffer picked for this host
+    static void expand(benchmark::State& st) {
+        std::array<std::uint64_t, 32> rows;
+        for (std::size_t i = 0; i < rows.size(); ++i)
+            rows[i] = 0x9E3779B97F4A7C15ULL * (i + 1);
+        std::vector<std::uint32_t> argb(64 * 32);
+
+        for (auto _ : st) {
+            Framebuffer::expandRows(rows.data(), rows.size(), argb.data(), 64);
+            benchmark::DoNotOptimize(argb.data());
+            benchmark::ClobberMemory();
+        }
+        st.SetItemsProcessed(st.iterations() * 64 * 32);
+        st.SetLabel(Framebuffer::kernel());
+    }
+
+    static void reportRate(benchmark::State& st, std::uint64_t instructions) {
+        st.SetItemsProcessed(static_cast<std::int64_t>(instructions));
+        st.counters["MIPS"] = benchmark::Counter(instructions / 1e6, benchmark::Counter::kIsRate);
+    }
+
+    // fetch + decode + execute through cycle(), one instruction per iteration
+    static void cycle(benchmark::State& st, const std::string& rom) {
+        Chip8 chip8;
+        chip8.loadROM(rom.c_str());
+
+        for (auto _ : st)
+            chip8.cycle();
+        reportRate(st, st.iterations());
+    }
+
+    // run() in 10000 instruction slices on the given backend
+    static void run(benchmark::State& st, const std::string& rom, Chip8::Backend backend) {
+        Chip8 chip8;
+        if (!chip8.setBackend(backend)) {
+            st.SkipWithError("backend isn't available on this host");
+            return;
+        }
+        chip8.loadROM(rom.c_str());
+
+        std::uint64_t executed = 0;
+        for (auto _ : st)
+            executed += chip8.run(10000);
+        reportRate(st, executed);
+    }
+
+    // resetting a machine with a ROM, from its file or from a RomLibrary image
+    static void load(benchmark::State& st, const std::string& path, bool library) {
+        RomLibrary roms;
+        roms.add(path);
+        const auto& image = roms.entries().front().image;
+        Chip8 chip8;
+
+        for (auto _ : st) {
+            if (library)
+                chip8.loadROM(image);
+            else
+                chip8.loadROM(path.c_str());
+            benchmark::DoNotOptimize(chip8.state());
+        }
+        st.SetItemsProcessed(st.iterations());
+    }
+
+    // kLanes copies of the ROM for kRomFrames frames, with the same seed and one lane per key
+    // pressed halfway, as an input search would. in lockstep, or as kLanes separate Chip8s
+    static void lanes(benchmark::State& st, const std::string& path, bool lockstep) {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<std::uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::uint64_t executed = 0;
+
+        for (auto _ : st) {
+            Lockstep group(kLanes);
+            std::vector<Chip8> scalar(lockstep ? 0 : kLanes);
+            group.loadROM(rom.data(), rom.size(), std::vector<std::uint64_t>(kLanes, 1));
+            for (Chip8& chip8 : scalar)
+                chip8.loadROM(rom.data(), rom.size(), 1);
+
+            for (unsigned f = 0; f < kRomFrames; ++f) {
+                if (f == kRomFrames / 2) {
+                    for (std::size_t lane = 0; lane < 16; ++lane) {
+                        if (lockstep)
+                            group.setKey(lane, static_cast<std::uint8_t>(lane), true);
+                        else
+                            scalar[lane].setKey(static_cast<std::uint8_t>(lane), true);
+                    }
+                }
+
+                if (lockstep)
+                    executed += group.runUntilFrame();
+                for (Chip8& chip8 : scalar)
+                    executed += chip8.runUntilFrame();
+            }
+        }
+        reportRate(st, executed);
+    }
+
+    // the ROM from a fresh reset for kRomFrames frames, stopping early on an invalid opcode
+    static void rom(benchmark::State& st, const std::string& path) {
+        Chip8 chip8;
+        chip8.setClockSpeed(kRomClockSpeed);
+        std::uint64_t executed = 0, frames = 0;
+
+        // test suite ROMs that hit unsupported opcodes would bury the results in error lines
+        std::cerr.setstate(std::ios::failbit);
+        for (auto _ : st) {
+            chip8.loadROM(path.c_str());
+            for (unsigned f = 0; f < kRomFrames && !chip8.faulted(); ++f, ++frames)
+                executed += chip8.runUntilFrame(kRomClockSpeed);
+        }
+        std::cerr.clear();
+
+        reportRate(st, executed);
+        st.counters["FPS"] = benchmark::Counter(static_cast<double>(frames), benchmark::Counter::kIsRate);
+    }
+};
+
+void Chip8Bench::registerAll() {
+    const struct {
+        const char*   name;
+        Handler       handler;
+        std::uint16_t opcode;
+    } opcodes[] = {
+        { "CLS",         &Chip8::CLS,         0x00E0 },
+        { "LD_Vx_byte",  &Chip8::LD_Vx_byte,  0x6A12 },
+        { "ADD_Vx_byte", &Chip8::ADD_Vx_byte, 0x7A03 },
+        { "LD_VxVy",     &Chip8::LD_VxVy,     0x8AB0 },
+        { "OR",          &Chip8::OR,          0x8AB1 },
+        { "AND",         &Chip8::AND,         0x8AB2 },
+        { "XOR",         &Chip8::XOR,         0x8AB3 },
+        { "ADD_VxVy",    &Chip8::ADD_VxVy,    0x8AB4 },
+        { "SUB",         &Chip8::SUB,         0x8AB5 },
+        { "SHR",         &Chip8::SHR,         0x8AB6 },
+        { "SUBN",        &Chip8::SUBN,        0x8AB7 },
+        { "SHL",         &Chip8::SHL,         0x8ABE },
+        { "RND",         &Chip8::RND,         0xCA7F },
+        { "ADD_I_Vx",    &Chip8::ADD_I_Vx,    0xFA1E },
+        { "LD_F_Vx",     &Chip8::LD_F_Vx,     0xFA29 },
+        { "LD_BCD",      &Chip8::LD_BCD,      0xFA33 },
+        { "LD_wVF",      &Chip8::LD_wVF,      0xFF55 },
+        { "LD_rVF",      &Chip8::LD_rVF,      0xFF65 },
+    };
+
+    for (const auto& op : opcodes)
+        benchmark::RegisterBenchmark((std::string("opcode/") + op.name).c_str(), opcode, op.handler, op.opcode);
+    benchmark::RegisterBenchmark("opcode/DRW", drw);
+    benchmark::RegisterBenchmark("framebuffer/expandRows", expand);
+
+    for (const char* name : { "Tetris.ch8", "Pong.ch8" }) {
+        const std::string path = std::string(CHIP8_ROM_DIR) + "/" + name;
+        benchmark::RegisterBenchmark((std::string("cycle/") + name).c_str(), cycle, path);
+        benchmark::RegisterBenchmark((std::string("run/interpreter/") + name).c_str(), run, path, Chip8::Backend::Interpreter);
+        if (Jit::available())
+            benchmark::RegisterBenchmark((std::string("run/jit/") + name).c_str(), run, path, Chip8::Backend::Jit);
+        benchmark::RegisterBenchmark((std::string("load/file/") + name).c_str(), load, path, false);
+        benchmark::RegisterBenchmark((std::string("load/library/") + name).c_str(), load, path, true);
+        benchmark::RegisterBenchmark((std::string("lanes/scalar/") + name).c_str(), lanes, path, false)
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark((std::string("lanes/lockstep/") + name).c_str(), lanes, path, true)
+            ->Unit(benchmark::kMillisecond);
+    }
+
+    std::vector<std::filesystem::path> roms;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(CHIP8_ROM_DIR))
+        if (entry.path().extension() == ".ch8")
+            roms.push_back(entry.path());
+    std::sort(roms.begin(), roms.end());
+
+    for (const auto& path : roms) {
+        const std::string name = "rom/" + std::filesystem::relative(path, CHIP8_ROM_DIR).generic_string();
+        benchmark::RegisterBenchmark(name.c_str(), rom, path.string())->Unit(benchmark::kMillisecond);
+    }
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    Chip8Bench::registerAll();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,70 @@
+// runs a ROM on the wasm core under Node, on a worker thread fed through a KeyRing as in the
+// browser (minus the canvas), and prints the same lines as chip8_headless --hash so the two
+// builds can be diffed:
+//   node core_headless.js <ROM> [--frames n] [--ips n] [--seed n] [--tap <key 0-F>]
+// the ROM path is inside the preloaded file system, e.g. roms/Pong.ch8. --tap presses and
+// releases a key before the first frame
+const { Worker, isMainThread, parentPort, workerData } = require("worker_threads");
+const KeyRing = require("./key_ring.js");
+
+if (isMainThread) {
+  const args = process.argv.slice(2);
+  const options = { rom: null, frames: 600, ips: 720, seed: 0, taps: [] };
+
+  for (let i = 0; i < args.length; ++i) {
+    const hasValue = i + 1 < args.length;
+    if (args[i] === "--frames" && hasValue) options.frames = parseInt(args[++i]);
+    else if (args[i] === "--ips" && hasValue) options.ips = parseInt(args[++i]);
+    else if (args[i] === "--seed" && hasValue) options.seed = parseInt(args[++i]);
+    else if (args[i] === "--tap" && hasValue) options.taps.push(parseInt(args[++i], 16));
+    else if (!args[i].startsWith("-")) options.rom = args[i];
+    else {
+      options.rom = null;
+      break;
+    }
+  }
+
+  if (!options.rom) {
+    console.error("Usage: node core_headless.js <ROM> [--frames n] [--ips n] [--seed n] [--tap <key 0-F>]");
+    process.exit(1);
+  }
+
+  const keys = KeyRing.create();
+  const ring = new KeyRing(keys);
+  for (const key of options.taps) {
+    ring.push(key, true);
+    ring.push(key, false);
+  }
+
+  const worker = new Worker(__filename, { workerData: { options: options, keys: keys } });
+  worker.on("message", (result) => {
+    console.log("cycles: " + result.cycles + "\nframes: " + result.frames + "\nhash: " + result.hash);
+  });
+  worker.on("error", (error) => {
+    console.error("[ERROR]\t(core_headless.js):\t " + error.message);
+    process.exit(1);
+  });
+}
+else {
+  const createChip8Core = require("./chip8_core.js");
+  const { options, keys } = workerData;
+  const ring = new KeyRing(keys);
+
+  createChip8Core().then((core) => {
+    if (!core.ccall("chip8_load", "number", ["string", "number"], [options.rom, options.seed]))
+      throw new Error("Couldn't load " + options.rom);
+    core._chip8_set_speed(options.ips);
+
+    for (let frame = 0; frame < options.frames; ++frame) {
+      for (let event; (event = ring.pop()) !== null; )
+        core._chip8_key(event.key, event.pressed ? 1 : 0);
+      core._chip8_run_frames(1, 0);
+    }
+
+    parentPort.postMessage({
+      cycles: core._chip8_cycles(),
+      frames: options.frames,
+      hash: core.ccall("chip8_frame_hash", "string", [], []),
+    });
+  });
+}
@@ -95,6 +95,14 @@ Module["onRuntimeInitialized"] = function () {
       getRomOptionsFromDropdown(event.target.value);
   };
 
+  // the clock speed outlives ROM changes, so it's set once here and again on every change
+  const speedDropdown = document.querySelector("#speed-dropdown");
+  Module.ccall("setSpeed", null, ["number"], [parseInt(speedDropdown.value)]);
+  speedDropdown.onchange = function (event) {
+      logMessage("speed: " + event.target.value + " instructions per second");
+      Module.ccall("setSpeed", null, ["number"], [parseInt(event.target.value)]);
+  };
+
   playButton.addEventListener("click", () => {
     if (Module.running) {
       logMessage("stopping the emulator...");
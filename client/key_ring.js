@@ -0,0 +1,51 @@
+// single-producer single-consumer ring of key events on a SharedArrayBuffer, the JavaScript twin
+// of SpscQueue: the page pushes from its key handlers, the emulation worker pops every frame.
+// neither side ever waits on the other, a full ring drops the event
+(function (root) {
+  "use strict";
+
+  const HEAD = 0;             // next slot to read, consumer only
+  const TAIL = 1;             // next slot to write, producer only
+  const SLOTS = 2;
+
+  class KeyRing {
+    static REWIND = 16;       // backspace, outside the 16 keypad keys
+
+    // capacity must be a power of two
+    static create(capacity = 256) {
+      return new SharedArrayBuffer((SLOTS + capacity) * Int32Array.BYTES_PER_ELEMENT);
+    }
+
+    constructor(buffer) {
+      this.cells = new Int32Array(buffer);
+      this.mask = this.cells.length - SLOTS - 1;
+    }
+
+    // producer side
+    push(key, pressed) {
+      const tail = Atomics.load(this.cells, TAIL);
+      if (((tail - Atomics.load(this.cells, HEAD)) | 0) > this.mask)
+        return false;
+
+      this.cells[SLOTS + (tail & this.mask)] = (key << 1) | (pressed ? 1 : 0);
+      Atomics.store(this.cells, TAIL, (tail + 1) | 0);
+      return true;
+    }
+
+    // consumer side: { key, pressed } or null if empty
+    pop() {
+      const head = Atomics.load(this.cells, HEAD);
+      if (head === Atomics.load(this.cells, TAIL))
+        return null;
+
+      const event = this.cells[SLOTS + (head & this.mask)];
+      Atomics.store(this.cells, HEAD, (head + 1) | 0);
+      return { key: event >> 1, pressed: (event & 1) === 1 };
+    }
+  }
+
+  if (typeof module !== "undefined" && module.exports)
+    module.exports = KeyRing;
+  else
+    root.KeyRing = KeyRing;
+})(this);
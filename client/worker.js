@@ -0,0 +1,89 @@
+// runs the wasm core (chip8_core.js, built from src/wasm_core.cpp) off the page's main thread.
+// it paces itself on the worker's own animation frames, reads key events from the KeyRing the
+// page fills, and draws straight into the OffscreenCanvas it was handed, so nothing the page
+// does can delay a frame
+importScripts("key_ring.js", "chip8_core.js");
+
+const FRAME_MS = 1000 / 60;
+
+let core = null;
+let ring = null;              // null without cross-origin isolation, keys come as messages then
+let context = null;
+let screen = null;            // 64 x 32 canvas the frame is put on before scaling
+let running = false;
+let rewinding = false;
+
+function logMessage(msg) {
+  console.log("[LOG]\t(worker.js):\t" + msg);
+}
+
+// animation frames in workers aren't everywhere yet, a timer does the same job a bit less smoothly
+const nextFrame = self.requestAnimationFrame
+  ? (callback) => self.requestAnimationFrame(callback)
+  : (callback) => setTimeout(() => callback(performance.now()), FRAME_MS);
+
+function applyKey(key, pressed) {
+  if (key === KeyRing.REWIND)
+    rewinding = pressed;
+  else
+    core._chip8_key(key, pressed ? 1 : 0);
+}
+
+function draw() {
+  const pixels = new Uint8ClampedArray(core.HEAPU8.buffer, core._chip8_pixels(), 64 * 32 * 4);
+  screen.getContext("2d").putImageData(new ImageData(pixels, 64, 32), 0, 0);
+  context.drawImage(screen, 0, 0, context.canvas.width, context.canvas.height);
+}
+
+function frame(now) {
+  if (!running)
+    return;
+
+  for (let event; ring && (event = ring.pop()) !== null; )
+    applyKey(event.key, event.pressed);
+
+  if (core._chip8_tick(now, rewinding ? 1 : 0))
+    draw();
+  nextFrame(frame);
+}
+
+self.onmessage = async function (e) {
+  const message = e.data;
+
+  switch (message.type) {
+    case "init":
+      core = await createChip8Core();
+      ring = message.keys ? new KeyRing(message.keys) : null;
+      context = message.canvas.getContext("2d");
+      context.imageSmoothingEnabled = false;
+      screen = new OffscreenCanvas(64, 32);
+      self.postMessage({ type: "ready" });
+      break;
+
+    case "load":
+      if (!core.ccall("chip8_load", "number", ["string", "number"], [message.path, Date.now()]))
+        logMessage("couldn't load " + message.path);
+      core._chip8_run_frames(0, 0);
+      draw();
+      break;
+
+    case "speed":
+      core._chip8_set_speed(message.ips);
+      break;
+
+    case "key":
+      applyKey(message.key, message.pressed);
+      break;
+
+    case "start":
+      if (!running) {
+        running = true;
+        nextFrame(frame);
+      }
+      break;
+
+    case "stop":
+      running = false;
+      break;
+  }
+};
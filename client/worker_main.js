@@ -0,0 +1,73 @@
+// page side of worker.html: hands the canvas to worker.js and forwards key events. nothing here
+// runs per frame, so the dropdowns and status updates can't hitch the emulator
+const status = document.getElementById("status");
+const playButton = document.getElementById("play-button");
+const romDropdown = document.getElementById("rom-dropdown");
+const speedDropdown = document.getElementById("speed-dropdown");
+
+// keyboard layout -> CHIP-8 key, the same as Gui::s_layout
+const layout = ["x", "1", "2", "3", "q", "w", "e", "a", "s", "d", "z", "c", "4", "r", "f", "v"];
+
+function logMessage(msg) {
+  console.log("[LOG]\t(worker_main.js):\t" + msg);
+}
+
+const worker = new Worker("worker.js");
+const canvas = document.getElementById("canvas").transferControlToOffscreen();
+
+// a SharedArrayBuffer needs the page to be cross-origin isolated (COOP / COEP headers),
+// otherwise every key event is a postMessage instead
+const keys = self.crossOriginIsolated ? KeyRing.create() : null;
+const ring = keys ? new KeyRing(keys) : null;
+let running = false;
+
+function sendKey(key, pressed) {
+  if (!ring)
+    worker.postMessage({ type: "key", key: key, pressed: pressed });
+  else if (!ring.push(key, pressed))
+    logMessage("key ring is full, dropped a key event");
+}
+
+function handleKey(e, pressed) {
+  const key = e.key === "Backspace" ? KeyRing.REWIND : layout.indexOf(e.key.toLowerCase());
+  if (key < 0 || e.repeat)
+    return;
+
+  e.preventDefault();
+  sendKey(key, pressed);
+}
+
+function loadSelectedRom() {
+  if (romDropdown.value === "Select a ROM")
+    return;
+
+  const romName = JSON.parse(romDropdown.value)["filename"];
+  worker.postMessage({ type: "load", path: "roms/" + romName });
+  playButton.disabled = false;
+  logMessage("loaded " + romName);
+}
+
+worker.onmessage = function (e) {
+  if (e.data.type !== "ready")
+    return;
+
+  status.innerHTML = ring ? "" : "Not cross-origin isolated, key events go through postMessage";
+  worker.postMessage({ type: "speed", ips: parseInt(speedDropdown.value) });
+  loadSelectedRom();
+
+  romDropdown.onchange = loadSelectedRom;
+  speedDropdown.onchange = function (event) {
+    worker.postMessage({ type: "speed", ips: parseInt(event.target.value) });
+  };
+
+  document.addEventListener("keydown", (event) => handleKey(event, true));
+  document.addEventListener("keyup", (event) => handleKey(event, false));
+
+  playButton.addEventListener("click", () => {
+    running = !running;
+    worker.postMessage({ type: running ? "start" : "stop" });
+    playButton.innerHTML = running ? "Stop" : "Play";
+  });
+};
+
+worker.postMessage({ type: "init", canvas: canvas, keys: keys }, [canvas]);
@@ -0,0 +1,55 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "rom_library.hpp"
+
+// scripted key press / release, applied at the start of the given frame
+struct ScriptedKey {
+    std::uint64_t frame;
+    std::uint8_t  key;
+    bool          pressed;
+};
+
+struct BatchJob {
+    std::string              romPath;                                   // or a RomLibrary entry name
+    std::uint64_t            frames = 600;                              // frames of 1/60 s to run
+    unsigned                 clockSpeed = Chip8::kDefaultClockSpeed;    // instructions per second
+    std::uint64_t            seed = Chip8::kDefaultSeed;                // for the RND instruction
+    std::vector<ScriptedKey> keys;                                      // sorted by frame
+};
+
+struct BatchResult {
+    enum class Exit : std::uint8_t {
+        Completed,                      // ran the whole frame budget
+        InvalidOpcode,                  // stopped at the end of the frame that hit an invalid opcode
+        LoadFailed,                     // ROM couldn't be read or doesn't fit in memory
+    };
+
+    Exit          exit = Exit::LoadFailed;
+    std::uint64_t cycles = 0;
+    std::uint64_t frames = 0;
+    std::uint64_t frameHash = 0;        // Chip8::frameHash() of the final screen
+};
+
+// runs jobs in parallel on a work-stealing pool of worker threads. every worker owns one Chip8
+// and reuses it for all the jobs it picks up, ROMs come decoded from a RomLibrary and are shared
+// read-only (Chip8::RomImage), so the emulation loop itself never touches shared mutable state.
+// results only depend on the job, never on which worker ran it
+class BatchRunner {
+public:
+    explicit BatchRunner(unsigned threads = 0);     // 0 = one per hardware thread
+
+    unsigned threads() const { return m_threads; }
+    std::vector<BatchResult> run(const std::vector<BatchJob>& jobs) const;     // maps every distinct romPath first
+    std::vector<BatchResult> run(const std::vector<BatchJob>& jobs, const RomLibrary& roms) const;
+
+private:
+    unsigned m_threads;
+};
+
+#endif
@@ -1,26 +1,132 @@
 #ifndef CHIP8_HPP
 #define CHIP8_HPP
 
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
 
-#ifndef EMSCRIPTEN
+#include "spsc_queue.hpp"
+
+#ifdef CHIP8_TESTING
 #include <gtest/gtest.h>
 #endif
 
+class Jit;
+class TraceWriter;
+
 class Chip8 {
 public:
+    enum class Backend {
+        Interpreter,                    // decode cache + basic blocks
+        Jit,                            // x86-64 translation, falls back to the interpreter
+    };
+
+    // complete machine state in one contiguous, trivially copyable block: everything
+    // an instruction touches on every cycle sits on the first cache line
+    struct alignas(64) State {
+        std::array<std::uint8_t, 16>  V;            // registers V0 - VF
+        std::uint16_t pc;
+        std::uint16_t index;                        // I
+        std::uint16_t sp;
+        std::uint8_t  delayTimer;
+        std::uint8_t  soundTimer;
+        std::array<std::uint8_t, 16>  key;          // keypad, 1 = pressed
+        std::uint32_t frameCycles;                  // instructions executed since the last timer tick
+        std::uint64_t cycles;                       // instructions executed since reset
+        std::uint64_t rng;                          // xorshift64* state for RND, never 0
+
+        alignas(64) std::array<std::uint16_t, 16>   stack;
+        alignas(64) std::array<std::uint8_t, 4096>  memory;
+        std::array<std::uint64_t, 32>               display;    // one word per row, bit 63 = column 0
+    };
+
+    static constexpr unsigned kTimerHz = 60;                // delay/sound timers tick at 60 Hz of emulated time
+    static constexpr unsigned kDefaultClockSpeed = 720;     // instructions per second
+    static constexpr std::uint64_t kDefaultSeed = 0;        // RND sequence used when no seed is given
+    static constexpr std::size_t kInputQueueSize = 32;      // a press and a release for every key, they drain within a frame
+
+    // a keypad change due before instruction number `cycle` (State::cycles) runs
+    struct KeyEvent {
+        std::uint64_t cycle;
+        std::uint8_t  key;
+        bool          pressed;
+    };
+
+    // serialized snapshot: "C8ST", u16 version, u16 reserved, then every State field in
+    // declaration order, little-endian, without padding
+    static constexpr std::uint16_t kSnapshotVersion = 1;
+    static constexpr std::size_t kSnapshotSize = 8 + 16 + 3 * 2 + 2 + 16 + 4 + 8 + 8 + 16 * 2 + 4096 + 32 * 8;
+
     Chip8();
     ~Chip8();
     
     void cycle();
-    bool loadROM(const char* ROM);
-    
-    std::vector<std::uint8_t> display;
-    std::vector<std::uint8_t> key;
+    std::uint64_t run(std::uint64_t maxCycles);
+    std::uint64_t runUntilFrame(std::uint64_t maxCycles = 100000);
+
+    void setClockSpeed(unsigned instructionsPerSecond);
+    unsigned clockSpeed() const { return m_cyclesPerFrame * kTimerHz; }
+    unsigned cyclesPerFrame() const { return m_cyclesPerFrame; }
+
+    bool setBackend(Backend backend);
+    Backend backend() const;
+#ifdef CHIP8_TRACE
+    void setTracer(TraceWriter* tracer) { m_tracer = tracer; }     // nullptr stops tracing
+#endif
+#ifdef CHIP8_PROFILE
+    // execution counters since the last reset. counted per instruction, so profiled builds
+    // never run JIT code
+    struct Profile {
+        static constexpr std::size_t kClasses = 36;
+        std::array<std::uint64_t, kClasses> classes;    // instructions executed per opcode class, see className()
+        std::array<std::uint64_t, 4096> pcHits;         // instructions executed per address
+        std::uint64_t draws;                            // DRW instructions
+        std::uint64_t pixels;                           // sprite pixels XORed onto the screen, after clipping
+        std::uint64_t frames;                           // timer ticks
+    };
+
+    const Profile& profile() const { return m_profile; }
+    static const char* className(std::size_t cls);     // "Fx07 LD_Vx_t", nullptr for unused classes
+    void writeProfileJson(std::ostream& out) const;
+    void writeProfileFolded(std::ostream& out) const;   // "<class>;<pc> <count>" lines for flamegraph.pl
+#endif
+    bool loadROM(const char* ROM, std::uint64_t seed = kDefaultSeed);
+    bool loadROM(const std::uint8_t* data, std::size_t size, std::uint64_t seed = kDefaultSeed);
+
+    // a ROM decoded once and shared read-only by every instance loaded from it, see RomImage
+    class RomImage;
+    static std::shared_ptr<const RomImage> loadImage(const std::uint8_t* data, std::size_t size);    // nullptr if too big
+    bool loadROM(std::shared_ptr<const RomImage> image, std::uint64_t seed = kDefaultSeed);
+
+    const State& state() const { return m_state; }
+    bool pixel(unsigned col, unsigned row) const { return (m_state.display[row] >> (63 - col)) & 1; }
+    void setKey(std::uint8_t key, bool pressed);
+    // queues a key change for the run loops to apply between exactly the right two instructions,
+    // in queue order. one other thread may call this while the emulator runs. false if full, or
+    // if enableInputQueue() wasn't called: batch jobs and Lockstep lanes use setKey() and never
+    // pay for the queue
+    void enableInputQueue();            // before the other thread starts, calling it again is a no-op
+    bool queueKey(const KeyEvent& event) { return m_input && m_input->push(event); }
+    void flushInput();                  // applies everything queued now, for jumps in time (rewind)
+    std::uint64_t frameHash() const;
+    std::uint32_t dirtyRows() const { return m_dirtyRows; }    // bit n = row n was drawn to since clearDirtyRows()
+    void clearDirtyRows() { m_dirtyRows = 0; }
+    bool faulted() const { return m_faulted; }       // an invalid opcode was hit since reset
+
+    // snapshots: the State overloads are a plain copy, the byte overloads use the versioned
+    // format above (for files). neither allocates
+    void saveState(State& out) const { out = m_state; }
+    void loadState(const State& in);
+    std::size_t saveState(std::uint8_t* buffer, std::size_t size) const;
+    bool loadState(const std::uint8_t* buffer, std::size_t size);
 
     std::uint16_t mask;                 // nibble - opcode & 0x000F         
     std::uint16_t byte;                 // kk     - opcode & 0x00FF         
@@ -30,7 +136,10 @@ public:
 
     bool drawFlag;
 
-#ifndef EMSCRIPTEN
+    friend class Chip8Bench;            // bench/chip8_bench.cpp drives the handlers directly
+    friend class Lockstep;              // shares the opcode table, handler ids and seeding
+
+#ifdef CHIP8_TESTING
     friend class Chip8Tests;
     FRIEND_TEST(Chip8Tests, Test_CLS);
     FRIEND_TEST(Chip8Tests, Test_RET);
@@ -54,7 +163,10 @@ public:
     FRIEND_TEST(Chip8Tests, Test_LD_I_addr);
     FRIEND_TEST(Chip8Tests, Test_JP_addrV0);
     FRIEND_TEST(Chip8Tests, Test_RND);
+    FRIEND_TEST(Chip8Tests, Test_RND_Seed);
     FRIEND_TEST(Chip8Tests, Test_DRW);
+    FRIEND_TEST(Chip8Tests, Test_DRW_Clip);
+    FRIEND_TEST(Chip8Tests, Test_DirtyRows);
     FRIEND_TEST(Chip8Tests, Test_SKP);
     FRIEND_TEST(Chip8Tests, Test_SKNP);
     FRIEND_TEST(Chip8Tests, Test_LD_Vx_t);
@@ -65,11 +177,82 @@ public:
     FRIEND_TEST(Chip8Tests, Test_LD_BCD);
     FRIEND_TEST(Chip8Tests, Test_LD_wVF);
     FRIEND_TEST(Chip8Tests, Test_LD_rVF);
+    FRIEND_TEST(Chip8Tests, Test_DecodeCache);
+    FRIEND_TEST(Chip8Tests, Test_DecodeCache_Invalidate);
+    FRIEND_TEST(Chip8Tests, Test_RomImage);
+    FRIEND_TEST(Chip8Tests, Test_RomLibrary);
+    FRIEND_TEST(Chip8Tests, Test_Run);
+    FRIEND_TEST(Chip8Tests, Test_RunUntilFrame);
+    FRIEND_TEST(Chip8Tests, Test_Timers);
+    FRIEND_TEST(Chip8Tests, Test_Run_SelfModifying);
+    FRIEND_TEST(Chip8Tests, Test_IdleLoop);
+    FRIEND_TEST(Chip8Tests, Test_IdleLoop_Key);
+    FRIEND_TEST(Chip8Tests, Test_InputQueue);
+    FRIEND_TEST(Chip8Tests, Test_SaveState);
+    FRIEND_TEST(Chip8Tests, Test_SaveState_Serialized);
+    FRIEND_TEST(Chip8Tests, Test_SaveState_Invalidate);
+    FRIEND_TEST(Chip8Tests, Test_Trace_Run);
+    FRIEND_TEST(Chip8Tests, Test_Profile);
+    FRIEND_TEST(Chip8Tests, Test_Jit_Opcodes);
+    FRIEND_TEST(Chip8Tests, Test_Jit_SelfModifying);
+    FRIEND_TEST(Chip8Tests, Test_Jit_Lockstep);
+    FRIEND_TEST(Chip8Tests, Test_Threaded_Lockstep);
 #endif
 
 private:
-    void reset();           
+    // predecoded instruction, one per even address in 0x200 - 0xFFF
+    struct DecodedOp {
+        std::uint16_t opcode;
+        std::uint16_t addr;
+        std::uint8_t  handler;          // index into s_handlers, op_none = not decoded yet
+        std::uint8_t  x;
+        std::uint8_t  y;
+        std::uint8_t  byte;
+        std::uint8_t  blockLen;         // length of the basic block starting here, 0 = not built yet
+    };
+
+    static constexpr unsigned kMaxBlockLength = 32;
+    static constexpr std::size_t kPageOps = 128;        // decoded ops per copy-on-write page (256 bytes of program)
+    static constexpr std::size_t kPages = (0x1000 - 0x200) / 2 / kPageOps;
+    static constexpr DecodedOp s_blankPage[kPageOps] = {};     // what every page reads as after a reset
+    static constexpr unsigned kMaxIdleLength = 32;      // longest busy-wait loop skipIdle() recognizes
+    static constexpr std::uint64_t kNoInput = std::numeric_limits<std::uint64_t>::max();
+
+    using Handler = void (Chip8::*)();
+
+    void reset(std::uint64_t seed = kDefaultSeed);
+    static std::uint64_t rngState(std::uint64_t seed);
+    std::uint8_t randomByte();
     void handleOpcodeError(const char* opcodeStr, std::uint16_t opcodeVal);
+    void invalidOpcode();
+    void profileHit(std::uint8_t handler);
+
+    static std::uint8_t decodeHandler(std::uint16_t opcode);
+    static const std::uint8_t* opcodeTable();
+    DecodedOp decode(std::uint16_t pc) const;
+    const DecodedOp& fetch();
+    void invalidateDecoded(std::uint16_t address);
+    const DecodedOp& decoded(std::size_t i) const { return m_pages[i / kPageOps][i % kPageOps]; }
+    DecodedOp& writable(std::size_t i);
+    void clearDecoded();
+
+    static bool endsBlock(std::uint8_t handler);
+    unsigned buildBlock(std::size_t first);
+    void execute(const DecodedOp& op);
+    void step();
+    void updateTimers();
+    bool advanceClock(unsigned cycles);
+    bool mayIdle() const;
+    unsigned idlePass(std::array<std::uint8_t, 16>& V, std::uint16_t* path) const;
+    std::uint64_t skipIdle(std::uint64_t budget);
+    std::uint64_t applyInput();
+    std::uint64_t runWithInput(std::uint64_t maxCycles, bool untilFrame);
+    std::uint64_t runEngine(std::uint64_t maxCycles, bool untilFrame);
+    std::uint64_t runBlocks(std::uint64_t maxCycles, bool untilFrame);
+    std::uint64_t runThreaded(std::uint64_t maxCycles, bool untilFrame);
+#ifdef CHIP8_TRACE
+    std::uint64_t runTraced(std::uint64_t maxCycles, bool untilFrame);
+#endif
 
     // instructions
     void CLS();                         // 00E0 - CLS
@@ -100,23 +283,53 @@ private:
     void LD_Vx_t();                     // Fx07 - LD Vx DT
     void LD_Vx_k();                     // Fx0A - LD Vx k
     void LD_t_Vx(std::uint8_t& timer);  // Fx15 & Fx18 - LD DT/ST Vx
+    void LD_DT_Vx();                    // Fx15 - LD DT Vx
+    void LD_ST_Vx();                    // Fx18 - LD ST Vx
     void ADD_I_Vx();                    // Fx1E - ADD I Vx
     void LD_F_Vx();                     // Fx29 - LD F Vx
     void LD_BCD();                      // Fx33 - LD B Vx (Vx BCD)
     void LD_wVF();                      // Fx55 - LD [I] Vx (write)
     void LD_rVF();                      // Fx65 - LD Vx. [I] (read)
 
-    std::vector<std::uint8_t>  m_V;     // registers V0 - VF
-    std::vector<std::uint8_t>  m_memory;
-    std::vector<std::uint16_t> m_stack;
-
-    std::uint16_t m_index;
+    State m_state;
     std::uint16_t m_opcode;
-    std::uint16_t m_pc;
-    std::uint16_t m_sp;
-    
-    std::uint8_t m_delayTimer;
-    std::uint8_t m_soundTimer;
+    bool m_faulted;
+    std::uint32_t m_dirtyRows;          // for frontends, not part of State
+    std::unique_ptr<SpscQueue<KeyEvent, kInputQueueSize>> m_input;    // filled by queueKey(), drained by applyInput()
+
+    // decoded ops for 0x200 - 0xFFF, one entry per even address, lazily filled (see fetch()) or
+    // shared with m_image until this instance writes to a page
+    std::array<const DecodedOp*, kPages> m_pages;
+    std::array<std::unique_ptr<DecodedOp[]>, kPages> m_owned;     // kept across resets
+    std::shared_ptr<const RomImage> m_image;
+    DecodedOp m_uncached;               // scratch entry for odd / non-program PCs
+
+    std::unique_ptr<Jit> m_jit;         // only set when the JIT backend is selected
+    unsigned m_cyclesPerFrame;          // instructions between two timer ticks
+#ifdef CHIP8_TRACE
+    TraceWriter* m_tracer = nullptr;    // not owned
+#endif
+#ifdef CHIP8_PROFILE
+    Profile m_profile;
+#endif
+
+    enum handlers : std::uint8_t {      // decoded handler ids, indices into s_handlers
+        op_none,    op_invalid,
+        op_CLS,     op_RET,     op_JP_addr,     op_CALL,
+        op_SE_Vx_byte,          op_SNE_Vx_byte, op_SE_VxVy,
+        op_LD_Vx_byte,          op_ADD_Vx_byte,
+        op_LD_VxVy, op_OR,      op_AND,         op_XOR,
+        op_ADD_VxVy,            op_SUB,         op_SHR,
+        op_SUBN,    op_SHL,     op_SNE_VxVy,
+        op_LD_I_addr,           op_JP_addrV0,   op_RND,
+        op_DRW,     op_SKP,     op_SKNP,
+        op_LD_Vx_t, op_LD_Vx_k, op_LD_DT_Vx,    op_LD_ST_Vx,
+        op_ADD_I_Vx,            op_LD_F_Vx,     op_LD_BCD,
+        op_LD_wVF,  op_LD_rVF,
+        op_count
+    };
+
+    static const Handler s_handlers[op_count];
 
     enum opcodes {                      // Instruction opcodes
         oc_00E_    =   0x0000,          // 00E?
@@ -159,7 +372,7 @@ private:
         oc_Fx65    =   0x0065,          // Fx65 : LD Vx, [I]
     };
 
-    std::uint8_t fontset[80] = {        // font hex representations
+    static constexpr std::uint8_t s_fontset[80] = {        // font hex representations
         0xF0, 0x90, 0x90, 0x90, 0xF0,   // 0
         0x20, 0x60, 0x20, 0x20, 0x70,   // 1
         0xF0, 0x10, 0xF0, 0x80, 0xF0,   // 2
@@ -179,4 +392,37 @@ private:
     };
 };
 
+// everything Chip8::loadROM() would leave behind, plus every instruction already decoded and
+// every basic block built. instances read it in place and only copy the pages they change, so
+// thousands of instances of one ROM share a single decode cache. State::memory stays a plain
+// per-instance copy, snapshots and rewind depend on it being one flat block
+class Chip8::RomImage {
+public:
+    std::size_t size() const { return m_size; }        // ROM bytes
+
+private:
+    friend class Chip8;
+
+    std::array<std::uint8_t, 4096> m_memory;
+    std::vector<DecodedOp> m_decoded;
+    std::size_t m_size = 0;
+};
+
+static_assert(std::is_trivially_copyable<Chip8::State>::value, "Chip8::State must stay memcpy-able");
+static_assert(offsetof(Chip8::State, key) + sizeof(Chip8::State::key) <= 64, "hot registers must share a cache line");
+
+// cheap pre-check for skipIdle(), which only looks for loops at jumps, Fx07 and Fx0A
+inline bool Chip8::mayIdle() const {
+    std::uint8_t hi = m_state.memory[m_state.pc & 0xFFF], lo = m_state.memory[(m_state.pc + 1) & 0xFFF];
+    return (hi >> 4) == 0x1 || ((hi >> 4) == 0xF && (lo == oc_Fx07 || lo == oc_Fx0A));
+}
+
+// compiles away unless profiling, the instruction about to run is at m_state.pc
+inline void Chip8::profileHit([[maybe_unused]] std::uint8_t handler) {
+#ifdef CHIP8_PROFILE
+    ++m_profile.classes[handler];
+    ++m_profile.pcHits[m_state.pc & 0xFFF];
+#endif
+}
+
 #endif
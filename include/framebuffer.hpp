@@ -0,0 +1,31 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// expands the 1-bit CHIP-8 screen into ARGB8888 pixels for textures and image export.
+// uses AVX2 or SSE2 on x86 (picked at runtime), SIMD128 in a -msimd128 WebAssembly build,
+// and a scalar loop everywhere else
+class Framebuffer {
+public:
+    struct Palette {
+        std::uint32_t foreground;       // ARGB of lit pixels
+        std::uint32_t background;
+    };
+
+    static constexpr Palette kDefaultPalette = { 0xFFFFFFFF, 0xFF000000 };
+
+    // packed rows as in Chip8::State::display (bit 63 = column 0), 64 pixels per row.
+    // row n starts at out + n * pitch, pitch counted in pixels
+    static void expandRows(const std::uint64_t* rows, std::size_t count, std::uint32_t* out, std::size_t pitch,
+        const Palette& palette = kDefaultPalette);
+
+    // one byte per pixel, 0 = background
+    static void expandBytes(const std::uint8_t* pixels, std::size_t count, std::uint32_t* out,
+        const Palette& palette = kDefaultPalette);
+
+    static const char* kernel();        // "avx2", "sse2", "simd128" or "scalar"
+};
+
+#endif
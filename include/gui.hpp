@@ -1,43 +1,61 @@
 #ifndef GUI_HPP
 #define GUI_HPP
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <string>
-#include <vector>
 #include "SDL2/SDL.h"
 
 #include "chip8.hpp"
+#include "framebuffer.hpp"
 
 class Gui {
 public:
-    Gui(int scale, const std::string& path, Chip8& chip8);
+    Gui(int scale, const std::string& path);
     ~Gui();
 
     void cleanup();
-    void handleInput();
-    void updateDisplay();
+    // queues keypad changes on chip8, stamped with `cycle` (the emulator's State::cycles as last
+    // seen by this thread). false once the window is closed or escape is pressed
+    bool handleInput(Chip8& chip8, std::uint64_t cycle);
+
+    // uploads each run of rows that differs from the last frame shown, presents only if any did
+    // (or the window was exposed)
+    void updateDisplay(const std::array<uint64_t, 32>& display);
 
     bool initialize();
+    // for a new ROM in the same window: held keys and press stamps belong to the old run
+    void restart();
+
+    // written by the thread polling input, safe to read from the emulation thread
+    bool rewinding() const { return m_rewinding.load(std::memory_order_relaxed); } // backspace is held down
     std::string romPath;
 
 private:
     void handleError(const char* message);
+    void queueKey(Chip8& chip8, int key, bool pressed, std::uint64_t cycle);
 
     SDL_Window* m_window;
     SDL_Renderer* m_renderer;
     SDL_Texture* m_texture;
 
     int m_scale;
-    std::vector<uint32_t> m_buffer;
+    std::atomic<bool> m_rewinding;
+    bool m_exposed;                             // the window needs presenting even if nothing changed
+    std::array<uint64_t, 32> m_shown;           // screen rows as last uploaded to m_texture
 
-    uint8_t m_keypad[16] = {
+    static constexpr SDL_Keycode s_layout[16] = {
         SDLK_x, SDLK_1, SDLK_2, SDLK_3, 
         SDLK_q, SDLK_w, SDLK_e, SDLK_a, 
         SDLK_s, SDLK_d, SDLK_z, SDLK_c, 
         SDLK_4, SDLK_r, SDLK_f, SDLK_v
     };
 
-    Chip8& m_chip8;
+    std::array<int8_t, 128> m_keymap;           // ASCII keycode -> keypad key, -1 = not mapped
+    uint16_t m_held;                            // bit n = key n is down
+    std::array<std::uint64_t, 16> m_pressedAt;  // stamp of each key's last press
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(EMSCRIPTEN)
+#define CHIP8_JIT_AVAILABLE 1
+#endif
+
+// translates straight-line CHIP-8 code into x86-64 machine code.
+// only register/ALU instructions, I updates and jumps/skips are compiled, everything
+// else (DRW, Fx0A, timers, keys, memory and stack access, RND) stays in the interpreter
+class Jit {
+public:
+    // compiled block: takes V0 - VF and I, returns the next PC
+    using BlockFn = std::uint32_t (*)(std::uint8_t* V, std::uint16_t* index);
+
+    struct Block {
+        BlockFn       fn;               // nullptr = nothing compilable at this address
+        std::uint8_t  length;           // number of CHIP-8 instructions covered by fn
+        bool          translated;       // false = not looked at yet
+    };
+
+    Jit();
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    static bool available();
+
+    const Block& lookup(std::uint16_t pc, const std::uint8_t* memory);
+    void invalidate(std::uint16_t address);
+    void flush();
+
+    static constexpr unsigned kMaxBlockLength = 32;
+
+private:
+    Block translate(std::uint16_t pc, const std::uint8_t* memory);
+
+    // emitter helpers
+    void emit(std::uint8_t b);
+    void emit16(std::uint16_t v);
+    void emit32(std::uint32_t v);
+    void emitRex(bool wide, int reg, int rm);
+    void emitOp8(std::uint8_t opcode, int rm, int reg);
+    void emitMovImm8(int reg, std::uint8_t imm);
+    void emitGroup1Imm8(int ext, int reg, std::uint8_t imm);
+    void emitShift8(int ext, int reg, std::uint8_t count);
+    void emitSetcc(int cc, int reg);
+    void emitMovzx8(int dst, int src);
+    void emitLoadV(int reg, int v);
+    void emitStoreV(int reg, int v);
+    void emitPush(int reg);
+    void emitPop(int reg);
+
+    std::vector<Block>        m_blocks;   // one per even address in 0x200 - 0xFFF
+    std::vector<std::uint8_t> m_code;     // scratch buffer for the block being translated
+
+    std::uint8_t* m_buffer;               // mmap'd code buffer
+    std::size_t   m_used;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef LOCKSTEP_HPP
+#define LOCKSTEP_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chip8.hpp"
+
+// runs many copies of one ROM (different RND seeds or key input) side by side. while their PCs
+// agree the machines share one fetch + decode, PC, stack and memory, and keep everything else
+// in structure-of-arrays form (all V0s together, all Is together, ...), so each instruction is
+// one loop over the lanes that the compiler vectorizes (AVX-512 / AVX2 clones picked at runtime
+// on x86-64). a lane that would go a different way (branch, key wait, memory write, ...) is
+// handed to its own scalar Chip8 right before that instruction and stays there
+class Lockstep {
+public:
+    explicit Lockstep(std::size_t lanes, unsigned clockSpeed = Chip8::kDefaultClockSpeed);
+    ~Lockstep();
+
+    Lockstep(const Lockstep&) = delete;
+    Lockstep& operator=(const Lockstep&) = delete;
+
+    // resets every lane into lockstep, lane n with seeds[n]. false if the ROM doesn't fit
+    bool loadROM(const std::uint8_t* data, std::size_t size, const std::vector<std::uint64_t>& seeds);
+
+    // runs every lane up to its next timer tick, returns the instructions executed over all lanes
+    std::uint64_t runUntilFrame();
+
+    void setKey(std::size_t lane, std::uint8_t key, bool pressed);
+    void saveState(std::size_t lane, Chip8::State& out) const;
+    bool faulted(std::size_t lane) const;       // only scalar lanes can hit an invalid opcode
+
+    std::size_t lanes() const { return m_lanes; }
+    std::size_t grouped() const { return m_count; }     // lanes still running in lockstep
+
+private:
+    static constexpr std::size_t kBlock = 64;           // lanes per vector loop, the columns are padded to it
+    static constexpr std::uint32_t kScalar = ~0u;       // m_slotOf entry of a lane that left the group
+
+    template <typename F> void forLanes(F f);
+    template <typename F> auto follow(F outcome);
+    template <typename F> void evictIf(F pred);
+    void evict(std::size_t slot);
+    void moveSlot(std::size_t from, std::size_t to);
+    void gather(std::size_t slot, Chip8::State& out) const;
+    void scatter(std::size_t slot, const Chip8::State& in);
+
+    void step();
+    void tick();
+
+    std::uint8_t* V(std::size_t reg) { return &m_V[reg * m_stride]; }
+    std::uint8_t* key(std::size_t k) { return &m_key[k * m_stride]; }
+    std::uint64_t* display(std::size_t row) { return &m_display[row * m_stride]; }
+
+    std::size_t m_lanes;
+    std::size_t m_stride;               // column length, m_lanes rounded up to kBlock
+    std::size_t m_count;                // lanes in the group, always slots 0 - m_count-1
+    unsigned m_clockSpeed;
+    unsigned m_cyclesPerFrame;
+
+    // shared by the whole group
+    std::uint16_t m_pc;
+    std::uint16_t m_sp;
+    std::uint32_t m_frameCycles;
+    std::uint64_t m_cycles;
+    std::array<std::uint16_t, 16>  m_stack;
+    std::array<std::uint8_t, 4096> m_memory;
+
+    // one column entry per slot
+    std::vector<std::uint8_t>  m_V;             // 16 columns
+    std::vector<std::uint16_t> m_index;
+    std::vector<std::uint8_t>  m_delayTimer;
+    std::vector<std::uint8_t>  m_soundTimer;
+    std::vector<std::uint8_t>  m_key;           // 16 columns
+    std::vector<std::uint64_t> m_rng;
+    std::vector<std::uint64_t> m_display;       // 32 columns
+    std::vector<std::uint32_t> m_laneOf;        // slot -> lane
+
+    std::vector<std::uint32_t> m_slotOf;        // lane -> slot, kScalar once it left the group
+    std::vector<std::unique_ptr<Chip8>> m_scalar;
+    std::shared_ptr<const Chip8::RomImage> m_image;     // decoded once for every evicted lane
+};
+
+#endif
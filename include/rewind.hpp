@@ -0,0 +1,46 @@
+#ifndef REWIND_HPP
+#define REWIND_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "chip8.hpp"
+
+// history of per-frame machine states for stepping backwards. every kKeyframeInterval-th state
+// is stored whole (a keyframe), the ones in between as the zero-run-length-encoded XOR against
+// their keyframe, which is usually a few dozen bytes. everything lives in one fixed-size byte
+// ring, the oldest frames are dropped once it's full
+class Rewind {
+public:
+    static constexpr unsigned kKeyframeInterval = 60;
+
+    explicit Rewind(std::size_t capacity = 4 * 1024 * 1024);
+
+    void push(const Chip8::State& state);   // record the state at the end of a frame
+    bool pop(Chip8::State& out);            // take back the most recent state, false when empty
+    void clear();
+
+    std::size_t frames() const { return m_entries.size(); }
+    std::size_t bytesUsed() const;
+
+private:
+    struct Entry {
+        std::size_t offset;                 // into m_ring
+        std::size_t size;
+        std::size_t keyOffset;              // keyframe this delta is relative to (== offset for keyframes)
+        unsigned    sinceKey;               // 0 for keyframes
+    };
+
+    std::size_t encode(const std::uint8_t* state, const std::uint8_t* key);
+    static void decode(const std::uint8_t* delta, std::size_t size, const std::uint8_t* key, std::uint8_t* out);
+    std::size_t allocate(std::size_t size);
+
+    std::vector<std::uint8_t> m_ring;
+    std::vector<std::uint8_t> m_scratch;    // encoded delta before it's copied into the ring
+    std::deque<Entry>         m_entries;    // oldest first
+    std::size_t               m_tail;       // next write position in m_ring
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef ROM_LIBRARY_HPP
+#define ROM_LIBRARY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chip8.hpp"
+
+// a ROM corpus read once: every file is memory-mapped (read in whole where mmap isn't available),
+// indexed by name and by content hash, and decoded into one shared Chip8::RomImage per distinct
+// ROM. loading an instance from it is chip8.loadROM(entry->image, seed), no file I/O and no
+// allocation. packed corpora ("CH8PACK" files, see writePack()) hold many ROMs in one mapping
+class RomLibrary {
+public:
+    struct Entry {
+        std::string         name;           // file path, or the name stored in the pack
+        std::uint64_t       hash;           // RomLibrary::hash() of the ROM bytes
+        const std::uint8_t* data;           // inside the mapping, valid as long as the library
+        std::size_t         size;
+        std::shared_ptr<const Chip8::RomImage> image;   // nullptr if empty or bigger than 0xE00 bytes
+    };
+
+    RomLibrary();
+    ~RomLibrary();
+
+    RomLibrary(const RomLibrary&) = delete;
+    RomLibrary& operator=(const RomLibrary&) = delete;
+
+    // a ROM file, a pack, or every .ch8 file / pack below a directory (in path order). false if
+    // the path can't be read or a pack is malformed. names already in the library are skipped
+    bool add(const std::string& path);
+
+    // valid until the next add()
+    const Entry* find(std::uint64_t hash) const;            // only loadable ROMs, nullptr if none
+    const Entry* find(const std::string& name) const;       // nullptr if never added
+    const std::vector<Entry>& entries() const { return m_entries; }
+
+    // packs every entry, loadable or not, so add(path) gives back the same names and bytes
+    bool writePack(const std::string& path) const;
+
+    // FNV-1a, the same function as Chip8::frameHash() uses
+    static std::uint64_t hash(const std::uint8_t* data, std::size_t size);
+
+private:
+    struct Mapping;
+
+    bool addFile(const std::string& path);
+    bool addPack(const Mapping& pack);
+    void addRom(const std::string& name, const std::uint8_t* data, std::size_t size);
+
+    std::vector<std::unique_ptr<Mapping>> m_mappings;
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::uint64_t, std::size_t> m_byHash;      // first loadable entry with the hash
+    std::unordered_map<std::string, std::size_t> m_byName;
+};
+
+#endif
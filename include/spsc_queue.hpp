@@ -0,0 +1,47 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+// fixed size FIFO between exactly one producer thread and one consumer thread, without locks.
+// push() never blocks, it fails when the queue is full
+template <typename T, std::size_t N>
+class SpscQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    SpscQueue() : m_slots{}, m_head(0), m_tail(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // producer side
+    bool push(const T& value) {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == N)
+            return false;
+
+        m_slots[tail & (N - 1)] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side: the oldest entry, nullptr if empty. stays valid until pop() or clear()
+    const T* front() const {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &m_slots[head & (N - 1)];
+    }
+
+    void pop() { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    void clear() { m_head.store(m_tail.load(std::memory_order_acquire), std::memory_order_release); }
+
+private:
+    T m_slots[N];
+    alignas(64) std::atomic<std::size_t> m_head;       // next entry to read, consumer only
+    alignas(64) std::atomic<std::size_t> m_tail;       // next entry to write, producer only
+};
+
+#endif
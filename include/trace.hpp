@@ -0,0 +1,100 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// instruction traces. a file is "C8TR", u16 version, u16 reserved, followed by one record per
+// executed instruction: u16 pc, u16 opcode, u16 I (after), u16 mask of the V registers the
+// instruction changed, then the new value of each changed register in ascending order.
+// all little-endian, so a typical record is 8 or 9 bytes
+
+struct TraceRecord {
+    std::uint16_t pc;
+    std::uint16_t opcode;
+    std::uint16_t index;
+    std::uint16_t changed;                  // bit n set = Vn was written with a new value
+    std::array<std::uint8_t, 16> V;         // only the entries flagged in changed are meaningful
+};
+
+// records into a ring of fixed-size chunks, full chunks are written out by a background thread
+// so the emulation thread never blocks on the disk unless the whole ring is full
+class TraceWriter {
+public:
+    static constexpr std::uint16_t kVersion = 1;
+
+    explicit TraceWriter(const std::string& path, std::size_t chunkSize = 256 * 1024, std::size_t chunks = 4);
+    ~TraceWriter();                         // flushes everything and stops the writer thread
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool ok() const { return m_ok; }
+
+    void record(std::uint16_t pc, std::uint16_t opcode, std::uint16_t index,
+        const std::uint8_t* before, const std::uint8_t* after) {
+        static constexpr std::size_t kMaxRecord = 8 + 16;
+        if (m_used + kMaxRecord > m_chunkSize)
+            submit();
+
+        std::uint8_t* out = m_current + m_used;
+        std::uint16_t changed = 0;
+        std::size_t n = 8;
+        for (int i = 0; i < 16; ++i) {
+            if (before[i] != after[i]) {
+                changed |= 1 << i;
+                out[n++] = after[i];
+            }
+        }
+
+        for (std::uint16_t v : { pc, opcode, index, changed }) {
+            *out++ = static_cast<std::uint8_t>(v);
+            *out++ = static_cast<std::uint8_t>(v >> 8);
+        }
+        m_used += n;
+    }
+
+    void flush();                           // hands over the partial chunk and waits for the disk
+
+private:
+    void submit();
+    void writerLoop();
+
+    std::ofstream m_file;
+    std::atomic<bool> m_ok;
+
+    std::size_t m_chunkSize;
+    std::vector<std::vector<std::uint8_t>> m_ring;
+    std::vector<std::size_t> m_sizes;       // bytes to write per chunk, 0 = free
+    std::size_t m_head;                     // next chunk the writer thread takes
+    std::size_t m_tail;                     // chunk being filled
+    std::uint8_t* m_current;
+    std::size_t m_used;
+
+    std::mutex m_lock;
+    std::condition_variable m_ready;        // a chunk was submitted, or stopping
+    std::condition_variable m_written;      // a chunk was written back to disk
+    bool m_stop;
+    std::thread m_thread;
+};
+
+class TraceReader {
+public:
+    explicit TraceReader(const std::string& path);
+
+    bool ok() const { return m_ok; }
+    bool next(TraceRecord& record);         // false at the end of the file or on a truncated record
+
+private:
+    std::ifstream m_file;
+    bool m_ok;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// hands the latest value from one producer thread to one consumer thread without locks or
+// waiting on either side. the producer fills back() and publish() swaps it with the spare
+// slot, the consumer's update() swaps the spare slot into front() if something new was
+// published. values the consumer never got to are simply overwritten
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : m_slots{}, m_spare(1), m_back(0), m_front(2) {}
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // producer side. back() isn't cleared after publishing, it holds whatever slot came back
+    T& back() { return m_slots[m_back]; }
+
+    void publish() {
+        m_back = m_spare.exchange(static_cast<std::uint8_t>(m_back | kFresh), std::memory_order_acq_rel) & kIndex;
+    }
+
+    // consumer side, returns false (and keeps front() as it was) if nothing new was published
+    bool update() {
+        if (!(m_spare.load(std::memory_order_relaxed) & kFresh))
+            return false;
+
+        m_front = m_spare.exchange(m_front, std::memory_order_acq_rel) & kIndex;
+        return true;
+    }
+
+    const T& front() const { return m_slots[m_front]; }
+
+private:
+    static constexpr std::uint8_t kIndex = 0x3;
+    static constexpr std::uint8_t kFresh = 0x4;        // the spare slot holds an unread value
+
+    T m_slots[3];
+    alignas(64) std::atomic<std::uint8_t> m_spare;     // index of the slot between the two threads
+    alignas(64) std::uint8_t m_back;                   // producer only
+    alignas(64) std::uint8_t m_front;                  // consumer only
+};
+
+#endif
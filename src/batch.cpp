@@ -0,0 +1,123 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+
+// per-worker job queue: the owner pops from the back, idle workers steal from the front.
+// padded to a cache line so neighbouring queues' locks don't false-share
+struct alignas(64) WorkQueue {
+    std::mutex              lock;
+    std::deque<std::size_t> jobs;
+
+    bool pop(std::size_t& job) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (jobs.empty())
+            return false;
+
+        job = jobs.back();
+        jobs.pop_back();
+        return true;
+    }
+
+    bool steal(std::size_t& job) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (jobs.empty())
+            return false;
+
+        job = jobs.front();
+        jobs.pop_front();
+        return true;
+    }
+};
+
+BatchResult runJob(Chip8& chip8, const BatchJob& job, const RomLibrary& roms) {
+    BatchResult result;
+    const RomLibrary::Entry* rom = roms.find(job.romPath);
+
+    if (!rom || !chip8.loadROM(rom->image, job.seed))
+        return result;
+
+    chip8.setClockSpeed(job.clockSpeed);
+    result.exit = BatchResult::Exit::Completed;
+
+    std::size_t nextKey = 0;
+    while (result.frames < job.frames) {
+        for (; nextKey < job.keys.size() && job.keys[nextKey].frame <= result.frames; ++nextKey)
+            chip8.setKey(job.keys[nextKey].key, job.keys[nextKey].pressed);
+
+        result.cycles += chip8.runUntilFrame(UINT64_MAX);
+        ++result.frames;
+
+        if (chip8.faulted()) {
+            result.exit = BatchResult::Exit::InvalidOpcode;
+            break;
+        }
+    }
+
+    result.frameHash = chip8.frameHash();
+    return result;
+}
+
+}
+
+BatchRunner::BatchRunner(unsigned threads) : m_threads(threads) {
+    if (m_threads == 0)
+        m_threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+// every distinct ROM is mapped and decoded once, jobs whose file can't be read or doesn't fit
+// fail to load
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchJob>& jobs) const {
+    RomLibrary roms;
+    std::unordered_set<std::string> paths;
+    for (const BatchJob& job : jobs) {
+        if (paths.insert(job.romPath).second)
+            roms.add(job.romPath);
+    }
+    return run(jobs, roms);
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchJob>& jobs, const RomLibrary& roms) const {
+    std::vector<BatchResult> results(jobs.size());
+
+    unsigned workers = static_cast<unsigned>(std::min<std::size_t>(m_threads, jobs.size()));
+    if (workers == 0)
+        return results;
+
+    // deal the jobs out round-robin, stealing evens out whatever imbalance is left
+    std::vector<WorkQueue> queues(workers);
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+        queues[i % workers].jobs.push_back(i);
+
+    auto worker = [&](unsigned self) {
+        Chip8 chip8;
+        std::size_t job;
+
+        while (true) {
+            bool found = queues[self].pop(job);
+            for (unsigned i = 1; !found && i < workers; ++i)
+                found = queues[(self + i) % workers].steal(job);
+
+            // nothing is ever added after the start, so empty everywhere means done
+            if (!found)
+                return;
+
+            results[job] = runJob(chip8, jobs[job], roms);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < workers; ++i)
+        threads.emplace_back(worker, i);
+
+    worker(0);
+    for (std::thread& t : threads)
+        t.join();
+
+    return results;
+}
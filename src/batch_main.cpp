@@ -0,0 +1,124 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+
+// runs every given ROM (or every ROM in the given directories and packs) in parallel and prints
+// one result line per job
+
+void handleError(const std::string& message) {
+    std::cerr << "[ERROR]\t(batch):\t " << message << "\n";
+    exit(-1);
+}
+
+void usage() {
+    std::cerr <<
+        "Usage: chip8_batch [options] <ROM-directory-or-pack>...\n"
+        "  --frames <n>     frames of 1/60 s to run per job (default: 600)\n"
+        "  --ips <n>        instructions per second of emulated time (default: 720)\n"
+        "  --seeds <n>      run every ROM with RND seeds 0 to n-1 (default: 1)\n"
+        "  --repeat <n>     run every ROM / seed pair n times (default: 1)\n"
+        "  --threads <n>    worker threads (default: one per hardware thread)\n"
+        "  --write-pack <f> pack every given ROM into one file for later runs, and exit\n";
+    exit(-1);
+}
+
+unsigned long long parseCount(const char* arg) {
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(arg, &end, 10);
+    if (end == arg || *end != '\0')
+        handleError(std::string("Expected a number, got: ") + arg);
+
+    return value;
+}
+
+const char* exitName(BatchResult::Exit exit) {
+    switch (exit) {
+        case BatchResult::Exit::Completed:      return "completed";
+        case BatchResult::Exit::InvalidOpcode:  return "invalid-opcode";
+        case BatchResult::Exit::LoadFailed:     return "load-failed";
+    }
+    return "unknown";
+}
+
+int main(int argc, char* argv[]) {
+    std::uint64_t frames = 600;
+    unsigned ips = Chip8::kDefaultClockSpeed;
+    unsigned long long repeat = 1;
+    unsigned long long seeds = 1;
+    unsigned threads = 0;
+    std::string packPath;
+    RomLibrary library;
+
+    // args
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--frames" && hasValue)
+            frames = parseCount(argv[++i]);
+        else if (arg == "--ips" && hasValue)
+            ips = static_cast<unsigned>(parseCount(argv[++i]));
+        else if (arg == "--seeds" && hasValue)
+            seeds = parseCount(argv[++i]);
+        else if (arg == "--repeat" && hasValue)
+            repeat = parseCount(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+            threads = static_cast<unsigned>(parseCount(argv[++i]));
+        else if (arg == "--write-pack" && hasValue)
+            packPath = argv[++i];
+        else if (arg[0] == '-')
+            usage();
+        else if (!library.add(arg))
+            handleError("Couldn't read " + arg);
+    }
+
+    if (library.entries().empty())
+        usage();
+
+    if (!packPath.empty()) {
+        if (!library.writePack(packPath))
+            handleError("Couldn't write " + packPath);
+        std::cerr << library.entries().size() << " ROMs packed into " << packPath << "\n";
+        return 0;
+    }
+
+    if (ips < Chip8::kTimerHz)
+        handleError("Instructions per second must be at least 60");
+
+    std::vector<BatchJob> jobs;
+    for (unsigned long long r = 0; r < repeat; ++r) {
+        for (const RomLibrary::Entry& rom : library.entries()) {
+            for (unsigned long long seed = 0; seed < seeds; ++seed) {
+                BatchJob job;
+                job.romPath = rom.name;
+                job.frames = frames;
+                job.clockSpeed = ips;
+                job.seed = seed;
+                jobs.push_back(job);
+            }
+        }
+    }
+
+    BatchRunner runner(threads);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results = runner.run(jobs, library);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::uint64_t totalCycles = 0;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        const BatchResult& r = results[i];
+        totalCycles += r.cycles;
+        std::cout << std::hex << std::setw(16) << std::setfill('0') << r.frameHash << std::dec << std::setfill(' ')
+            << "  " << std::setw(14) << exitName(r.exit) << "  " << std::setw(10) << r.cycles << " cycles  "
+            << std::setw(6) << r.frames << " frames  seed " << jobs[i].seed << "  " << jobs[i].romPath << "\n";
+    }
+
+    std::cerr << std::dec << jobs.size() << " jobs on " << runner.threads() << " threads in " << elapsed.count() << " s ("
+        << (totalCycles / elapsed.count() / 1e6) << " MIPS)\n";
+    return 0;
+}
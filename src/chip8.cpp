@@ -1,27 +1,96 @@
 #include "chip8.hpp"
+#include "jit.hpp"
+#ifdef CHIP8_PROFILE
+#include <bitset>
+#endif
+#ifdef CHIP8_TRACE
+#include "trace.hpp"
+#endif
 
-Chip8::Chip8() : m_index(0), m_opcode(0), m_pc(0x200), m_sp(0) {}
+Chip8::Chip8() : mask(0), byte(0), addr(0), x(0), y(0), drawFlag(false), m_state{}, m_opcode(0), m_faulted(false),
+    m_dirtyRows(0), m_cyclesPerFrame(kDefaultClockSpeed / kTimerHz) {
+    reset();
+}
 
 Chip8::~Chip8() {}
 
-void Chip8::reset() {
-    // initializing vector sizes
-    m_memory.resize(4096);                            
-    display.resize(64 * 64);
-    m_stack.resize(16);
-    key.resize(16);
-    m_V.resize(16);
+// switches execution engines at runtime, returns false if the JIT isn't supported on this host
+bool Chip8::setBackend(Backend backend) {
+    if (backend == Backend::Interpreter) {
+        m_jit.reset();
+        return true;
+    }
 
-    // resetting timers
-    m_soundTimer = 0;
-    m_delayTimer = 0;
+    if (!Jit::available())
+        return false;
+
+    if (!m_jit)
+        m_jit = std::make_unique<Jit>();
+    return true;
+}
+
+Chip8::Backend Chip8::backend() const {
+    return m_jit ? Backend::Jit : Backend::Interpreter;
+}
+
+// sets how many instructions run per second of emulated time, rounded down to whole frames
+void Chip8::setClockSpeed(unsigned instructionsPerSecond) {
+    m_cyclesPerFrame = std::max(1u, instructionsPerSecond / kTimerHz);
+    m_state.frameCycles = std::min(m_state.frameCycles, m_cyclesPerFrame - 1);
+}
+
+// splitmix64 step, spreads nearby seeds apart and never leaves xorshift with a zero state
+std::uint64_t Chip8::rngState(std::uint64_t seed) {
+    std::uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return z ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+void Chip8::reset(std::uint64_t seed) {
+    m_state = State{};
+    m_state.pc = 0x200;
+
+    m_state.rng = rngState(seed);
+    m_faulted = false;
+    m_dirtyRows = ~0u;
+    if (m_input)
+        m_input->clear();               // stamped against the old run, so they'd land anywhere
+#ifdef CHIP8_PROFILE
+    m_profile = Profile{};
+#endif
+
+    clearDecoded();
+    if (m_jit)
+        m_jit->flush();
 
     // loading fonts into memory
-    for (int i = 0; i < 80; ++i)
-        m_memory[i] = fontset[i];                     
+    std::copy(std::begin(s_fontset), std::end(s_fontset), m_state.memory.begin());
+}
 
-    // rng
-    srand(time(NULL));                             
+// xorshift64*, per instance so parallel machines never contend and runs replay bit-exactly
+std::uint8_t Chip8::randomByte() {
+    m_state.rng ^= m_state.rng >> 12;
+    m_state.rng ^= m_state.rng << 25;
+    m_state.rng ^= m_state.rng >> 27;
+    return static_cast<std::uint8_t>((m_state.rng * 0x2545F4914F6CDD1DULL) >> 56);
+}
+
+void Chip8::setKey(std::uint8_t key, bool pressed) {
+    m_state.key[key & 0xF] = pressed ? 1 : 0;
+}
+
+// FNV-1a over the packed framebuffer rows, for comparing screens across runs
+std::uint64_t Chip8::frameHash() const {
+    std::uint64_t hash = 0xCBF29CE484222325ULL;
+    for (std::uint64_t row : m_state.display) {
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            hash ^= (row >> shift) & 0xFF;
+            hash *= 0x100000001B3ULL;
+        }
+    }
+    return hash;
 }
 
 void Chip8::handleOpcodeError(const char* opcodeStr, std::uint16_t opcodeVal) {
@@ -29,363 +98,1054 @@ void Chip8::handleOpcodeError(const char* opcodeStr, std::uint16_t opcodeVal) {
         << std::hex << std::uppercase << opcodeVal << "\n";
 }
 
-bool Chip8::loadROM(const char* path) {
-    // initializing Chip8 and loading ROM from given path 
-    reset();                                     
-    std::ifstream file(path, std::ios::ate);         
+bool Chip8::loadROM(const char* path, std::uint64_t seed) {
+    // initializing Chip8 and reading the ROM straight into program memory
+    reset(seed);
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+
+    std::streamoff fileSize = file.tellg();
+    if (fileSize < 0 || static_cast<std::size_t>(fileSize) > m_state.memory.size() - 0x200)
+        return false;
+
+    file.seekg(0, std::ios::beg);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&m_state.memory[0x200]), fileSize));
+}
 
-    if (file.is_open()) {
-        std::streampos fileSize = file.tellg();
-        std::vector<char> buffer(fileSize);         
+// same as above, for ROMs that are already in memory
+bool Chip8::loadROM(const std::uint8_t* data, std::size_t size, std::uint64_t seed) {
+    reset(seed);
+    if (size > m_state.memory.size() - 0x200)
+        return false;
 
-        // reading file from beginning 
-        file.seekg(0, std::ios::beg);
-        file.read(&buffer[0], fileSize);            // storing data within buffer
-        file.close();
+    std::copy(data, data + size, m_state.memory.begin() + 0x200);
+    return true;
+}
 
-        for(long i = 0; i < fileSize; ++i)
-            m_memory[0x200 + i] = buffer[i];        // loading buffer data to memory
+// decodes the ROM once up front, for instances to share through loadROM(image)
+std::shared_ptr<const Chip8::RomImage> Chip8::loadImage(const std::uint8_t* data, std::size_t size) {
+    Chip8 chip8;
+    if (!chip8.loadROM(data, size))
+        return nullptr;
 
-        return true;
+    // building a block at every address decodes everything, exactly as running into it would
+    auto image = std::make_shared<RomImage>();
+    image->m_decoded.reserve(kPages * kPageOps);
+    for (std::size_t i = 0; i < kPages * kPageOps; ++i) {
+        if (chip8.decoded(i).blockLen == 0)
+            chip8.buildBlock(i);
+        if (chip8.decoded(i).handler == op_none)
+            chip8.writable(i) = chip8.decode(static_cast<std::uint16_t>(0x200 + (i << 1)));
+        image->m_decoded.push_back(chip8.decoded(i));
     }
-    else {
+
+    image->m_memory = chip8.m_state.memory;
+    image->m_size = size;
+    return image;
+}
+
+bool Chip8::loadROM(std::shared_ptr<const RomImage> image, std::uint64_t seed) {
+    reset(seed);
+    if (!image)
         return false;
+
+    // m_owned is kept, so loading over and over never allocates
+    m_state.memory = image->m_memory;
+    for (std::size_t page = 0; page < kPages; ++page)
+        m_pages[page] = &image->m_decoded[page * kPageOps];
+    m_image = std::move(image);
+    return true;
+}
+
+// restores a snapshot. cached decodes / JIT blocks are only dropped where the program bytes
+// actually differ, so forking machines that run the same code stays about as cheap as a memcpy
+void Chip8::loadState(const State& in) {
+    for (std::size_t chunk = 0x200; chunk < 0x1000; chunk += 64) {
+        if (std::equal(in.memory.begin() + chunk, in.memory.begin() + chunk + 64, m_state.memory.begin() + chunk))
+            continue;
+
+        for (std::size_t address = chunk; address < chunk + 64; ++address)
+            if (in.memory[address] != m_state.memory[address])
+                invalidateDecoded(static_cast<std::uint16_t>(address & ~1u));
     }
+
+    for (std::size_t row = 0; row < m_state.display.size(); ++row)
+        m_dirtyRows |= static_cast<std::uint32_t>(in.display[row] != m_state.display[row]) << row;
+
+    m_state = in;
+    m_state.frameCycles = std::min(m_state.frameCycles, m_cyclesPerFrame - 1);
+    drawFlag = true;
 }
 
-// CPU cycles: fetch --> decode --> execute opcode
-void Chip8::cycle() { 
-    // fetching
-    m_opcode  = m_memory[m_pc] << 8 | m_memory[m_pc + 1];
+static_assert(Chip8::kSnapshotSize == 8 + sizeof(Chip8::State::V) + 3 * 2 + 2 + sizeof(Chip8::State::key) + 4 + 8 + 8
+    + sizeof(Chip8::State::stack) + sizeof(Chip8::State::memory) + sizeof(Chip8::State::display),
+    "kSnapshotSize is out of sync with Chip8::State");
+
+namespace {
+
+// little-endian field cursor for the snapshot format
+struct SnapshotWriter {
+    std::uint8_t* out;
+
+    template <typename T> void put(T value) {
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+            *out++ = static_cast<std::uint8_t>(static_cast<std::uint64_t>(value) >> (8 * i));
+    }
+    template <typename T, std::size_t N> void put(const std::array<T, N>& values) {
+        for (T value : values)
+            put(value);
+    }
+};
+
+struct SnapshotReader {
+    const std::uint8_t* in;
+
+    template <typename T> void get(T& value) {
+        std::uint64_t v = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+            v |= static_cast<std::uint64_t>(*in++) << (8 * i);
+        value = static_cast<T>(v);
+    }
+    template <typename T, std::size_t N> void get(std::array<T, N>& values) {
+        for (T& value : values)
+            get(value);
+    }
+};
+
+}
+
+// returns the number of bytes written, 0 if the buffer is smaller than kSnapshotSize
+std::size_t Chip8::saveState(std::uint8_t* buffer, std::size_t size) const {
+    if (size < kSnapshotSize)
+        return 0;
+
+    SnapshotWriter w{ buffer };
+    for (char c : { 'C', '8', 'S', 'T' })
+        w.put(static_cast<std::uint8_t>(c));
+    w.put(kSnapshotVersion);
+    w.put(std::uint16_t{ 0 });
+
+    w.put(m_state.V);
+    w.put(m_state.pc);
+    w.put(m_state.index);
+    w.put(m_state.sp);
+    w.put(m_state.delayTimer);
+    w.put(m_state.soundTimer);
+    w.put(m_state.key);
+    w.put(m_state.frameCycles);
+    w.put(m_state.cycles);
+    w.put(m_state.rng);
+    w.put(m_state.stack);
+    w.put(m_state.memory);
+    w.put(m_state.display);
+
+    return static_cast<std::size_t>(w.out - buffer);
+}
+
+// rejects anything that isn't a complete snapshot of this version, leaving the machine untouched
+bool Chip8::loadState(const std::uint8_t* buffer, std::size_t size) {
+    if (size < kSnapshotSize || buffer[0] != 'C' || buffer[1] != '8' || buffer[2] != 'S' || buffer[3] != 'T')
+        return false;
+
+    SnapshotReader r{ buffer + 4 };
+    std::uint16_t version, reserved;
+    r.get(version);
+    r.get(reserved);
+    if (version != kSnapshotVersion)
+        return false;
+
+    State in{};
+    r.get(in.V);
+    r.get(in.pc);
+    r.get(in.index);
+    r.get(in.sp);
+    r.get(in.delayTimer);
+    r.get(in.soundTimer);
+    r.get(in.key);
+    r.get(in.frameCycles);
+    r.get(in.cycles);
+    r.get(in.rng);
+    r.get(in.stack);
+    r.get(in.memory);
+    r.get(in.display);
 
-    mask    = m_opcode & 0x000F;
+    if (in.rng == 0)                            // xorshift would be stuck at 0
+        return false;
 
-    byte    = m_opcode & 0x00FF;                    // aka "kk"
-    addr    = m_opcode & 0x0FFF;                      
+    loadState(in);
+    return true;
+}
 
-    x       = (m_opcode & 0x0F00) >> 8;
-    y       = (m_opcode & 0x00F0) >> 4; 
-    
-    // decoding and executing
-    switch(m_opcode & 0xF000) {
+const Chip8::Handler Chip8::s_handlers[op_count] = {
+    nullptr,                &Chip8::invalidOpcode,
+    &Chip8::CLS,            &Chip8::RET,            &Chip8::JP_addr,        &Chip8::CALL,
+    &Chip8::SE_Vx_byte,     &Chip8::SNE_Vx_byte,    &Chip8::SE_VxVy,
+    &Chip8::LD_Vx_byte,     &Chip8::ADD_Vx_byte,
+    &Chip8::LD_VxVy,        &Chip8::OR,             &Chip8::AND,            &Chip8::XOR,
+    &Chip8::ADD_VxVy,       &Chip8::SUB,            &Chip8::SHR,
+    &Chip8::SUBN,           &Chip8::SHL,            &Chip8::SNE_VxVy,
+    &Chip8::LD_I_addr,      &Chip8::JP_addrV0,      &Chip8::RND,
+    &Chip8::DRW,            &Chip8::SKP,            &Chip8::SKNP,
+    &Chip8::LD_Vx_t,        &Chip8::LD_Vx_k,        &Chip8::LD_DT_Vx,       &Chip8::LD_ST_Vx,
+    &Chip8::ADD_I_Vx,       &Chip8::LD_F_Vx,        &Chip8::LD_BCD,
+    &Chip8::LD_wVF,         &Chip8::LD_rVF,
+};
+
+// maps an opcode to its handler id
+std::uint8_t Chip8::decodeHandler(std::uint16_t opcode) {
+    switch(opcode & 0xF000) {
         case oc_00E_:                               // 00E? 
-            switch (mask) { 
+            switch (opcode & 0x000F) { 
                 case oc_00E0:                       // 00E0 (CLS) : clears display
-                    CLS();
-                    break;
+                    return op_CLS;
                 case oc_00EE:                       // 00EE (RET) : returns from subroutine
-                     RET();
-                    break;
-                default:                            // invalid opcode
-                    handleOpcodeError("[0x00E?]", m_opcode);
+                    return op_RET;
             } 
             break;
         case oc_1nnn:                               // 1nnn (JP) : jumps to addr
-            JP_addr();
-            break;
+            return op_JP_addr;
         case oc_2nnn:                               // 2nnn (CALL) : calls subroutine at addr
-            CALL();
-            break;
+            return op_CALL;
         case oc_3xkk:                               // 3xkk (SE) : skips next instruction if Vx = kk
-            SE_Vx_byte();
-            break;
+            return op_SE_Vx_byte;
         case oc_4xkk:                               // 4xkk (SNE) : skips next instruction if Vx != kk
-            SNE_Vx_byte();
-            break;
+            return op_SNE_Vx_byte;
         case oc_5xy0:                               // 5xy0 (SE) : skips next instruction of Vx = Vy
-            SE_VxVy();
-            break;
+            return op_SE_VxVy;
         case oc_6xkk:                               // 6xkk (LD) : puts value of kk into register Vx 
-            LD_Vx_byte();
-            break;
+            return op_LD_Vx_byte;
         case oc_7xkk:                               // 7xkk (ADD) : adds kk to Vx, stores result in Vx
-            ADD_Vx_byte();
-            break;
+            return op_ADD_Vx_byte;
         case oc_8xy_:                               // 8xy?
-            switch (mask) {
+            switch (opcode & 0x000F) {
                 case oc_8xy0:                       // 8xy0 (LD) : stores value of Vy in Vx
-                    LD_VxVy();
-                    break;
+                    return op_LD_VxVy;
                 case oc_8xy1:                       // 8xy1 (OR) : performs OR on Vx and Vy, stores result in Vx
-                    OR();
-                    break;
+                    return op_OR;
                 case oc_8xy2:                       // 8xy2 (AND) : performs AND on Vx and Vy, stores result in Vx 
-                    AND();
-                    break;
+                    return op_AND;
                 case oc_8xy3:                       // 8xy3 (XOR) : performs XOR on Vx and Vy, stores result in Vx
-                    XOR();
-                    break;
+                    return op_XOR;
                 case oc_8xy4:                       // 8xy4 (ADD) : adds Vx and Vy. if result > 8 bits, VF=1, else VF=0.
-                    ADD_VxVy();                     //              only lowest 8 bits of result are stored in Vx
-                    break;
+                    return op_ADD_VxVy;             //              only lowest 8 bits of result are stored in Vx
                 case oc_8xy5:                       // 8xy5 (SUB) : Vx -= Vy. results are stored in Vx. 
-                    SUB();                          //              then if Vx > Vy, VF=1, else VF=0.
-                    break;
+                    return op_SUB;                  //              then if Vx > Vy, VF=1, else VF=0.
                 case oc_8xy6:                       // 8xy6 (SHR) : if LSB of Vx=1, VF=1, else VF=0. then shift Vx right
-                    SHR();                          //              by 1 (div by 2)
-                    break;
+                    return op_SHR;                  //              by 1 (div by 2)
                 case oc_8xy7:                       // 8xy7 (SUBN) : Vx =- Vy. results are stored in Vx.
-                    SUBN();                         //               then if Vx > Vy, VF=1, else VF=0.
-                    break;
+                    return op_SUBN;                 //               then if Vx > Vy, VF=1, else VF=0.
                 case oc_8xyE:                       // 8xyE (SHL) : if MSB of Vx=1, VF=1, else VF=0. then shift Vx left
-                    SHL();                          //              by 1 (mul by 2)
-                    break;
-                default:                            // invalid opcode
-                    handleOpcodeError("[0x8xy?]", m_opcode);
-                    return;
+                    return op_SHL;                  //              by 1 (mul by 2)
             }
             break;
         case oc_9xy0:                               // 9xy0 (SNE) : skip next instruction if Vx != Vy
-            SNE_VxVy();
-            break;
+            return op_SNE_VxVy;
         case oc_Annn:                               // Annn (LD) : set I = nnn
-            LD_I_addr();
-            break;
+            return op_LD_I_addr;
         case oc_Bnnn:                               // Bnnn (JP) : jump to location nnn + V0
-            JP_addrV0();
-            break;
+            return op_JP_addrV0;
         case oc_Cxkk:                               // Cxkk (RND) : set Vx = random byte & kk
-            RND();
-            break;
+            return op_RND;
         case oc_Dxyn:                               // Dxyn (DRW) : display n-byte sprite starting from 
-            DRW();                                  //              memory location I at (Vx, Vy), set
-            break;                                  //              VF = collision
+            return op_DRW;                          //              memory location I at (Vx, Vy), set
+                                                    //              VF = collision
         case oc_Ex__:                               // Ex??
-            switch (byte) {
+            switch (opcode & 0x00FF) {
                 case oc_Ex9E:                       // Ex9E (SKP) : skip next instruction if key with value of Vx is pressed
-                    SKP();
-                    break;
+                    return op_SKP;
                 case oc_ExA1:                       // ExA1 (SKNP) : skip next instruction if key with value of Vx isnt pressed
-                    SKNP();
-                    break;
-                default:                            // invalid opcode
-                    handleOpcodeError("[0xEx?]", m_opcode);
-                    return;
+                    return op_SKNP;
             }
             break;
         case oc_Fx__:                               // Fx??
-            switch (byte) {
+            switch (opcode & 0x00FF) {
                 case oc_Fx07:                       // Fx07 (LD) : set Vx to the value of the delay timer
-                    LD_Vx_t();
-                    break;
+                    return op_LD_Vx_t;
                 case oc_Fx0A:                       // Fx0A (LD) : wait for a key press, store the value into Vx
-                    LD_Vx_k();
-                    break;
+                    return op_LD_Vx_k;
                 case oc_Fx15:                       // Fx15 (LD) : set delay timer to the value of Vx
-                    LD_t_Vx(m_delayTimer);
-                    break;
+                    return op_LD_DT_Vx;
                 case oc_Fx18:                       // Fx18 (LD) : set sound timer to the value of Vx
-                    LD_t_Vx(m_soundTimer);
-                    break;
+                    return op_LD_ST_Vx;
                 case oc_Fx1E:                       // Fx1E (ADD) : add Vx to I
-                    ADD_I_Vx();
-                    break;
+                    return op_ADD_I_Vx;
                 case oc_Fx29:                       // Fx29 (LD) : set I to location of sprite for digit Vx
-                    LD_F_Vx();
-                    break;
+                    return op_LD_F_Vx;
                 case oc_Fx33:                       // Fx33  (LD) : store BCD representation of Vx in I, I+1 and I+2
-                    LD_BCD();
-                    break;
+                    return op_LD_BCD;
                 case oc_Fx55:                       // Fx55 (LD) : store registers V0-Vx in memory starting at location I
-                    LD_wVF();
-                    break;
+                    return op_LD_wVF;
                 case oc_Fx65:                       // Fx65 (LD) : read registers V0-Vx from memory starting at location I
-                    LD_rVF();
+                    return op_LD_rVF;
+            }
+            break;
+    }
+
+    return op_invalid;
+}
+
+// 64K-entry opcode -> handler id table for the threaded interpreter, shared by all instances
+const std::uint8_t* Chip8::opcodeTable() {
+    static const std::vector<std::uint8_t> table = [] {
+        std::vector<std::uint8_t> t(0x10000);
+        for (std::size_t opcode = 0; opcode < t.size(); ++opcode)
+            t[opcode] = decodeHandler(static_cast<std::uint16_t>(opcode));
+        return t;
+    }();
+
+    return table.data();
+}
+
+// decodes the instruction at pc into a handler id + pre-extracted operands
+Chip8::DecodedOp Chip8::decode(std::uint16_t pc) const {
+    DecodedOp op;
+    op.opcode   = m_state.memory[pc & 0xFFF] << 8 | m_state.memory[(pc + 1) & 0xFFF];
+    op.addr     = op.opcode & 0x0FFF;
+    op.x        = (op.opcode & 0x0F00) >> 8;
+    op.y        = (op.opcode & 0x00F0) >> 4;
+    op.byte     = op.opcode & 0x00FF;           // aka "kk"
+    op.handler  = decodeHandler(op.opcode);
+    op.blockLen = 0;
+
+    return op;
+}
+
+// returns the decoded instruction at PC, decoding it on first use
+const Chip8::DecodedOp& Chip8::fetch() {
+    if ((m_state.pc & 1) == 0 && m_state.pc >= 0x200 && m_state.pc < 0x1000) {
+        std::size_t i = (m_state.pc - 0x200) >> 1;
+        const DecodedOp& op = decoded(i);
+        if (op.handler != op_none)
+            return op;
+
+        return writable(i) = decode(m_state.pc);
+    }
+
+    // odd or out of program space PCs are rare, so they aren't cached
+    m_uncached = decode(m_state.pc);
+    return m_uncached;
+}
+
+// drops the cached decode of the instruction covering address (self-modifying code),
+// along with any basic block that contains it
+void Chip8::invalidateDecoded(std::uint16_t address) {
+    if (address < 0x200 || address >= 0x1000)
+        return;
+
+    std::size_t last  = (address - 0x200) >> 1;
+    std::size_t first = (last >= kMaxBlockLength) ? last - kMaxBlockLength + 1 : 0;
+
+    writable(last).handler = op_none;
+    for (std::size_t i = first; i <= last; ++i)
+        if (i + decoded(i).blockLen > last)
+            writable(i).blockLen = 0;
+
+    if (m_jit)
+        m_jit->invalidate(address);
+}
+
+// the decoded op at index i, for changing it. a page still shared with m_image is copied first
+Chip8::DecodedOp& Chip8::writable(std::size_t i) {
+    std::size_t page = i / kPageOps;
+    if (m_pages[page] != m_owned[page].get()) {
+        if (!m_owned[page])
+            m_owned[page].reset(new DecodedOp[kPageOps]);
+        std::copy(m_pages[page], m_pages[page] + kPageOps, m_owned[page].get());
+        m_pages[page] = m_owned[page].get();
+    }
+    return m_owned[page][i % kPageOps];
+}
+
+// every page undecoded, the state after a reset. they all point at s_blankPage until written
+void Chip8::clearDecoded() {
+    m_image.reset();
+    m_pages.fill(s_blankPage);
+}
+
+// instructions that change control flow, wait on input, draw or write memory end a basic block
+bool Chip8::endsBlock(std::uint8_t handler) {
+    switch (handler) {
+        case op_RET:
+        case op_JP_addr:
+        case op_CALL:
+        case op_SE_Vx_byte:
+        case op_SNE_Vx_byte:
+        case op_SE_VxVy:
+        case op_SNE_VxVy:
+        case op_JP_addrV0:
+        case op_DRW:
+        case op_SKP:
+        case op_SKNP:
+        case op_LD_Vx_k:
+        case op_LD_BCD:
+        case op_LD_wVF:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// decodes the straight-line run of instructions starting at decoded(first), returns its length.
+// invalid opcodes are never part of a block, so they always go through cycle(). blocks end at
+// a page boundary, so each one is contiguous however the pages are shared
+unsigned Chip8::buildBlock(std::size_t first) {
+    std::size_t last = std::min(first + kMaxBlockLength, (first / kPageOps + 1) * kPageOps);
+    unsigned len = 0;
+
+    for (std::size_t i = first; i < last; ++i) {
+        if (decoded(i).handler == op_none)
+            writable(i) = decode(static_cast<std::uint16_t>(0x200 + (i << 1)));
+
+        std::uint8_t handler = decoded(i).handler;
+        if (handler == op_invalid)
+            break;
+
+        ++len;
+        if (endsBlock(handler))
+            break;
+    }
+
+    // an invalid opcode's 0 is already there, shared pages aren't copied just to store it again
+    if (decoded(first).blockLen != len)
+        writable(first).blockLen = static_cast<std::uint8_t>(len);
+    return len;
+}
+
+void Chip8::execute(const DecodedOp& op) {
+    m_opcode = op.opcode;
+    mask     = op.opcode & 0x000F;
+    byte     = op.byte;
+    addr     = op.addr;
+    x        = op.x;
+    y        = op.y;
+
+    profileHit(op.handler);
+    (this->*s_handlers[op.handler])();
+}
+
+void Chip8::updateTimers() {
+    if (m_state.delayTimer > 0)
+        --m_state.delayTimer;
+
+    if (m_state.soundTimer > 0)
+        --m_state.soundTimer;
+}
+
+// counts executed instructions and ticks the timers once a whole frame's worth has run,
+// returns true on a tick
+bool Chip8::advanceClock(unsigned cycles) {
+    m_state.cycles += cycles;
+    m_state.frameCycles += cycles;
+    if (m_state.frameCycles < m_cyclesPerFrame)
+        return false;
+
+    m_state.frameCycles = 0;
+    updateTimers();
+#ifdef CHIP8_PROFILE
+    ++m_profile.frames;
+#endif
+    return true;
+}
+
+// one pass around a polling loop on a copy of the registers. only instructions that read the
+// delay timer, keypad, registers or code and write nothing but V are followed, so the pass is
+// a pure function of V until the next tick or key event. returns the loop length, 0 if the code
+// at pc isn't such a loop
+unsigned Chip8::idlePass(std::array<std::uint8_t, 16>& V, std::uint16_t* path) const {
+    const std::uint16_t start = m_state.pc;
+    std::uint16_t pc = start;
+
+    for (unsigned length = 1; length <= kMaxIdleLength; ++length) {
+        const std::uint16_t opcode = m_state.memory[pc & 0xFFF] << 8 | m_state.memory[(pc + 1) & 0xFFF];
+        const std::uint8_t  vx = (opcode & 0x0F00) >> 8;
+        const std::uint8_t  vy = (opcode & 0x00F0) >> 4;
+        path[length - 1] = pc;
+
+        switch (opcode & 0xF000) {
+            case oc_1nnn: pc = opcode & 0x0FFF; break;
+            case oc_3xkk: pc += (V[vx] == (opcode & 0x00FF)) ? 4 : 2; break;
+            case oc_4xkk: pc += (V[vx] != (opcode & 0x00FF)) ? 4 : 2; break;
+            case oc_6xkk: V[vx] = opcode & 0x00FF; pc += 2; break;
+            case oc_5xy0:
+            case oc_9xy0:
+                if (opcode & 0x000F)
+                    return 0;
+                pc += ((V[vx] == V[vy]) == ((opcode & 0xF000) == oc_5xy0)) ? 4 : 2;
+                break;
+            case oc_Ex__:
+                if ((opcode & 0x00FF) != oc_Ex9E && (opcode & 0x00FF) != oc_ExA1)
+                    return 0;
+                pc += ((m_state.key[V[vx] & 0xF] != 0) == ((opcode & 0x00FF) == oc_Ex9E)) ? 4 : 2;
+                break;
+            case oc_Fx__:
+                if ((opcode & 0x00FF) == oc_Fx07) {
+                    V[vx] = m_state.delayTimer;
+                    pc += 2;
                     break;
-                default:                            // invalid opcode
-                    handleOpcodeError("[0xF000]", m_opcode);
-                    return;
+                }
+                // Fx0A with a key down stores it and moves on, without one it's a loop by itself
+                if ((opcode & 0x00FF) == oc_Fx0A
+                    && std::none_of(m_state.key.begin(), m_state.key.end(), [](std::uint8_t k) { return k != 0; }))
+                    break;
+                return 0;
+            default:
+                return 0;
+        }
+
+        if (pc == start)
+            return length;
+    }
+    return 0;
+}
+
+// busy-wait loops (polling the delay timer or keypad, a jump to itself, Fx0A with no key down)
+// can't make progress before the next timer tick. once one pass around the loop leaves the
+// registers unchanged every later pass will too, so as many passes as fit in budget are
+// skipped, leaving the machine exactly as running them would. returns the instructions skipped
+std::uint64_t Chip8::skipIdle(std::uint64_t budget) {
+    if ((m_state.pc & 1) || m_state.pc >= 0x1000)
+        return 0;
+
+    std::array<std::uint8_t, 16> first = m_state.V;
+    std::uint16_t firstPath[kMaxIdleLength], loopPath[kMaxIdleLength];
+    unsigned firstLength = idlePass(first, firstPath);
+    if (firstLength == 0 || firstLength > budget)
+        return 0;
+
+    std::array<std::uint8_t, 16> second = first;
+    unsigned loopLength = idlePass(second, loopPath);
+    if (loopLength == 0 || second != first)
+        return 0;
+
+    std::uint64_t loops = (budget - firstLength) / loopLength;
+    m_state.V = first;
+
+#ifdef CHIP8_PROFILE
+    auto credit = [this](const std::uint16_t* path, unsigned length, std::uint64_t times) {
+        for (unsigned i = 0; i < length; ++i) {
+            std::uint16_t pc = path[i] & 0xFFF;
+            m_profile.classes[decodeHandler(m_state.memory[pc] << 8 | m_state.memory[(pc + 1) & 0xFFF])] += times;
+            m_profile.pcHits[pc] += times;
+        }
+    };
+    credit(firstPath, firstLength, 1);
+    credit(loopPath, loopLength, loops);
+#endif
+
+    return firstLength + loops * loopLength;
+}
+
+// CPU cycles: fetch --> decode --> execute opcode
+void Chip8::cycle() { 
+    applyInput();
+    step();
+    advanceClock(1);
+}
+
+void Chip8::step() {
+    // fetching + decoding (cached)
+    const DecodedOp& op = fetch();
+
+#ifdef CHIP8_TRACE
+    if (m_tracer) {
+        std::uint16_t pc = m_state.pc;
+        std::array<std::uint8_t, 16> before = m_state.V;
+
+        m_opcode = op.opcode;
+        if (op.handler == op_invalid)
+            invalidOpcode();
+        else
+            execute(op);
+
+        m_tracer->record(pc, m_opcode, m_state.index, before.data(), m_state.V.data());
+        return;
+    }
+#endif
+
+    // executing
+    if (op.handler == op_invalid) {
+        m_opcode = op.opcode;
+        invalidOpcode();
+        return;
+    }
+    execute(op);
+}
+
+// executes up to maxCycles instructions, returns the number executed. the interpreter runs a
+// basic block at a time, or threaded if built with CHIP8_THREADED_DISPATCH
+std::uint64_t Chip8::run(std::uint64_t maxCycles) {
+    return runWithInput(maxCycles, false);
+}
+
+// like run(), but stops at the end of the current frame, right after the timers tick
+std::uint64_t Chip8::runUntilFrame(std::uint64_t maxCycles) {
+    return runWithInput(maxCycles, true);
+}
+
+void Chip8::enableInputQueue() {
+    if (!m_input)
+        m_input = std::make_unique<SpscQueue<KeyEvent, kInputQueueSize>>();
+}
+
+// applies the queued key events that are due, returns the cycle the next one is due at
+std::uint64_t Chip8::applyInput() {
+    if (!m_input)
+        return kNoInput;
+
+    while (const KeyEvent* event = m_input->front()) {
+        if (event->cycle > m_state.cycles)
+            return event->cycle;
+        setKey(event->key, event->pressed);
+        m_input->pop();
+    }
+    return kNoInput;
+}
+
+void Chip8::flushInput() {
+    if (!m_input)
+        return;
+
+    while (const KeyEvent* event = m_input->front()) {
+        setKey(event->key, event->pressed);
+        m_input->pop();
+    }
+}
+
+// runs the engine in slices ending where the next key event is due, so an event lands between
+// the same two instructions however the run is split up. nothing queued = a single slice
+std::uint64_t Chip8::runWithInput(std::uint64_t maxCycles, bool untilFrame) {
+    std::uint64_t executed = 0;
+
+    while (executed < maxCycles) {
+        std::uint64_t next = applyInput();
+        executed += runEngine(std::min(maxCycles - executed, next - m_state.cycles), untilFrame);
+        if (next == kNoInput || (untilFrame && m_state.frameCycles == 0))
+            break;
+    }
+
+    return executed;
+}
+
+std::uint64_t Chip8::runEngine(std::uint64_t maxCycles, bool untilFrame) {
+#ifdef CHIP8_TRACE
+    if (m_tracer)
+        return runTraced(maxCycles, untilFrame);
+#endif
+#ifdef CHIP8_THREADED_DISPATCH
+    if (!m_jit)
+        return runThreaded(maxCycles, untilFrame);
+#endif
+    return runBlocks(maxCycles, untilFrame);
+}
+
+std::uint64_t Chip8::runBlocks(std::uint64_t maxCycles, bool untilFrame) {
+    std::uint64_t executed = 0;
+
+    while (executed < maxCycles) {
+        // blocks never run past the next timer tick, so Fx07 reads the same value as with cycle()
+        std::uint64_t budget = std::min<std::uint64_t>(maxCycles - executed, m_cyclesPerFrame - m_state.frameCycles);
+
+        if (std::uint64_t skipped = mayIdle() ? skipIdle(budget) : 0) {
+            executed += skipped;
+            if (advanceClock(static_cast<unsigned>(skipped)) && untilFrame)
+                break;
+            continue;
+        }
+
+        std::size_t first = (m_state.pc - 0x200) >> 1;
+        bool inProgram = (m_state.pc & 1) == 0 && m_state.pc >= 0x200 && m_state.pc < 0x1000;
+#ifdef CHIP8_PROFILE
+        const Jit::Block* block = nullptr;      // translated blocks can't count their instructions
+#else
+        const Jit::Block* block = (m_jit && inProgram) ? &m_jit->lookup(m_state.pc, m_state.memory.data()) : nullptr;
+#endif
+        unsigned len = 0;
+
+        if (block && block->fn && block->length <= budget) {
+            m_state.pc = static_cast<std::uint16_t>(block->fn(m_state.V.data(), &m_state.index));
+            len = block->length;
+        }
+        else {
+            if (inProgram) {
+                len = decoded(first).blockLen;
+                if (len == 0)
+                    len = buildBlock(first);
+            }
+
+            if (len == 0 || len > budget) {
+                // no block here (odd PC, invalid opcode) or not enough budget left for the whole block
+                step();
+                len = 1;
+            }
+            else {
+                const DecodedOp* op  = &decoded(first);
+                const DecodedOp* end = op + len;
+                for (; op != end; ++op)
+                    execute(*op);
             }
+        }
+
+        executed += len;
+        if (advanceClock(len) && untilFrame)
+            break;
+    }
+
+    return executed;
+}
+
+#ifdef CHIP8_TRACE
+// one instruction at a time through step(), bypassing blocks, the JIT and threaded dispatch,
+// so every instruction gets its own trace record
+std::uint64_t Chip8::runTraced(std::uint64_t maxCycles, bool untilFrame) {
+    std::uint64_t executed = 0;
+
+    while (executed < maxCycles) {
+        step();
+        ++executed;
+        if (advanceClock(1) && untilFrame)
+            break;
+    }
+
+    return executed;
+}
+#endif
+
+// threaded interpreter: every handler fetches and dispatches the next opcode itself through
+// the 64K opcode table, so each one gets its own indirect branch to predict
+#if defined(__GNUC__) && !defined(__EMSCRIPTEN__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#ifdef __clang__
+#pragma clang diagnostic ignored "-Wgnu-label-as-value"
+#endif
+
+std::uint64_t Chip8::runThreaded(std::uint64_t maxCycles, bool untilFrame) {
+    static void* const labels[op_count] = {
+        &&l_invalid,        &&l_invalid,
+        &&l_CLS,            &&l_RET,            &&l_JP_addr,        &&l_CALL,
+        &&l_SE_Vx_byte,     &&l_SNE_Vx_byte,    &&l_SE_VxVy,
+        &&l_LD_Vx_byte,     &&l_ADD_Vx_byte,
+        &&l_LD_VxVy,        &&l_OR,             &&l_AND,            &&l_XOR,
+        &&l_ADD_VxVy,       &&l_SUB,            &&l_SHR,
+        &&l_SUBN,           &&l_SHL,            &&l_SNE_VxVy,
+        &&l_LD_I_addr,      &&l_JP_addrV0,      &&l_RND,
+        &&l_DRW,            &&l_SKP,            &&l_SKNP,
+        &&l_LD_Vx_t,        &&l_LD_Vx_k,        &&l_LD_DT_Vx,       &&l_LD_ST_Vx,
+        &&l_ADD_I_Vx,       &&l_LD_F_Vx,        &&l_LD_BCD,
+        &&l_LD_wVF,         &&l_LD_rVF,
+    };
+
+    const std::uint8_t* table = opcodeTable();
+    std::uint64_t executed = 0;
+
+    // the instruction being dispatched is already counted in executed
+    auto idleBudget = [&] {
+        return std::min<std::uint64_t>(maxCycles - executed + 1, m_cyclesPerFrame - m_state.frameCycles);
+    };
+
+#define DISPATCH()                                                              \
+    do {                                                                        \
+        if (executed == maxCycles)                                              \
+            return executed;                                                    \
+        ++executed;                                                             \
+        m_opcode = m_state.memory[m_state.pc & 0xFFF] << 8 | m_state.memory[(m_state.pc + 1) & 0xFFF];  \
+        mask = m_opcode & 0x000F;                                               \
+        byte = m_opcode & 0x00FF;                                               \
+        addr = m_opcode & 0x0FFF;                                               \
+        x    = (m_opcode & 0x0F00) >> 8;                                        \
+        y    = (m_opcode & 0x00F0) >> 4;                                        \
+        goto *labels[table[m_opcode]];                                          \
+    } while (0)
+
+#define HANDLER(name)                                                           \
+    l_##name:                                                                   \
+        profileHit(op_##name);                                                  \
+        name();                                                                 \
+        if (advanceClock(1) && untilFrame)                                      \
+            return executed;                                                    \
+        DISPATCH();
+
+// instructions that can start a busy-wait loop try skipIdle() first
+#define IDLE_HANDLER(name)                                                      \
+    l_##name:                                                                   \
+        if (std::uint64_t skipped = skipIdle(idleBudget())) {                   \
+            executed += skipped - 1;                                            \
+            if (advanceClock(static_cast<unsigned>(skipped)) && untilFrame)     \
+                return executed;                                                \
+            DISPATCH();                                                         \
+        }                                                                       \
+        profileHit(op_##name);                                                  \
+        name();                                                                 \
+        if (advanceClock(1) && untilFrame)                                      \
+            return executed;                                                    \
+        DISPATCH();
+
+    DISPATCH();
+
+    HANDLER(CLS)        HANDLER(RET)        IDLE_HANDLER(JP_addr) HANDLER(CALL)
+    HANDLER(SE_Vx_byte) HANDLER(SNE_Vx_byte) HANDLER(SE_VxVy)
+    HANDLER(LD_Vx_byte) HANDLER(ADD_Vx_byte)
+    HANDLER(LD_VxVy)    HANDLER(OR)         HANDLER(AND)        HANDLER(XOR)
+    HANDLER(ADD_VxVy)   HANDLER(SUB)        HANDLER(SHR)
+    HANDLER(SUBN)       HANDLER(SHL)        HANDLER(SNE_VxVy)
+    HANDLER(LD_I_addr)  HANDLER(JP_addrV0)  HANDLER(RND)
+    HANDLER(DRW)        HANDLER(SKP)        HANDLER(SKNP)
+    IDLE_HANDLER(LD_Vx_t) IDLE_HANDLER(LD_Vx_k) HANDLER(LD_DT_Vx) HANDLER(LD_ST_Vx)
+    HANDLER(ADD_I_Vx)   HANDLER(LD_F_Vx)    HANDLER(LD_BCD)
+    HANDLER(LD_wVF)     HANDLER(LD_rVF)
+
+    l_invalid:
+        invalidOpcode();
+        if (advanceClock(1) && untilFrame)
+            return executed;
+        DISPATCH();
+
+#undef IDLE_HANDLER
+#undef HANDLER
+#undef DISPATCH
+}
+
+#pragma GCC diagnostic pop
+
+#else
+
+// portable fallback (Emscripten, MSVC): same opcode table, dispatched through s_handlers
+std::uint64_t Chip8::runThreaded(std::uint64_t maxCycles, bool untilFrame) {
+    const std::uint8_t* table = opcodeTable();
+    std::uint64_t executed = 0;
+
+    while (executed < maxCycles) {
+        std::uint64_t budget = std::min<std::uint64_t>(maxCycles - executed, m_cyclesPerFrame - m_state.frameCycles);
+        if (std::uint64_t skipped = mayIdle() ? skipIdle(budget) : 0) {
+            executed += skipped;
+            if (advanceClock(static_cast<unsigned>(skipped)) && untilFrame)
+                break;
+            continue;
+        }
+
+        ++executed;
+        m_opcode = m_state.memory[m_state.pc & 0xFFF] << 8 | m_state.memory[(m_state.pc + 1) & 0xFFF];
+        mask = m_opcode & 0x000F;
+        byte = m_opcode & 0x00FF;
+        addr = m_opcode & 0x0FFF;
+        x    = (m_opcode & 0x0F00) >> 8;
+        y    = (m_opcode & 0x00F0) >> 4;
+
+        std::uint8_t handler = table[m_opcode];
+        if (handler == op_invalid)
+            invalidOpcode();
+        else {
+            profileHit(handler);
+            (this->*s_handlers[handler])();
+        }
+
+        if (advanceClock(1) && untilFrame)
             break;
-        default:                                    // invalid opcode, starts with val outside of hex range 0-F
-            handleOpcodeError("[0x?000]", m_opcode);
-            return;
     }
 
-    // updating timers 
-    if (m_delayTimer > 0)
-        --m_delayTimer;
+    return executed;
+}
+
+#endif
 
-    if (m_soundTimer > 0)
-        --m_soundTimer;
+void Chip8::invalidOpcode() {
+    profileHit(op_invalid);
+    m_faulted = true;
+    switch (m_opcode & 0xF000) {
+        case oc_00E_:
+            handleOpcodeError("[0x00E?]", m_opcode);
+            break;
+        case oc_8xy_:
+            handleOpcodeError("[0x8xy?]", m_opcode);
+            break;
+        case oc_Ex__:
+            handleOpcodeError("[0xEx?]", m_opcode);
+            break;
+        default:
+            handleOpcodeError("[0xF000]", m_opcode);
+    }
 }
 
 // 00E0
 void Chip8::CLS() {
-    for (int i = 0; i < 2048; ++i) 
-        display[i] = 0;
+    m_state.display.fill(0);
 
+    m_dirtyRows = ~0u;
     drawFlag = true;
-    m_pc += 2;
+    m_state.pc += 2;
 }                                                   
 
 // 00EE
 void Chip8::RET() {
-    --m_sp;
-    m_pc = m_stack[m_sp];
-    m_pc += 2;
+    --m_state.sp;
+    m_state.pc = m_state.stack[m_state.sp & 0xF];         // stack wraps instead of reading past its end
+    m_state.pc += 2;
 }                                         
 
 // 1nnn
 void Chip8::JP_addr() { 
-    m_pc = addr; 
+    m_state.pc = addr; 
 }                                                        
 
 // 2nnn
 void Chip8::CALL() {
-    m_stack[m_sp] = m_pc;
-    ++m_sp;
-    m_pc = addr;
+    m_state.stack[m_state.sp & 0xF] = m_state.pc;
+    ++m_state.sp;
+    m_state.pc = addr;
 }                                                        
 
 // 3xkk
 void Chip8::SE_Vx_byte() { 
-    m_pc += (m_V[x] == byte) ? 4 : 2; 
+    m_state.pc += (m_state.V[x] == byte) ? 4 : 2; 
 }                                            
 
 // 4xkk
 void Chip8::SNE_Vx_byte() { 
-    m_pc += (m_V[x] != byte) ? 4 : 2; 
+    m_state.pc += (m_state.V[x] != byte) ? 4 : 2; 
 }                                           
 
 // 5xy0
 void Chip8::SE_VxVy() { 
-    m_pc += (m_V[x] == m_V[y]) ? 4 : 2; 
+    m_state.pc += (m_state.V[x] == m_state.V[y]) ? 4 : 2; 
 }                                              
 
 // 6xkk
 void Chip8::LD_Vx_byte() { 
-    m_V[x] = byte; m_pc += 2; 
+    m_state.V[x] = byte; m_state.pc += 2; 
 }                                                         
 
 // 7xkk
 void Chip8::ADD_Vx_byte() { 
-    m_V[x] += byte; m_pc += 2; 
+    m_state.V[x] += byte; m_state.pc += 2; 
 }                                                        
 
 // 8xy0
 void Chip8::LD_VxVy() { 
-    m_V[x] = m_V[y]; m_pc += 2; 
+    m_state.V[x] = m_state.V[y]; m_state.pc += 2; 
 }                                                         
 
 // 8xy1
 void Chip8::OR() { 
-    m_V[x] |= m_V[y]; m_pc += 2; 
+    m_state.V[x] |= m_state.V[y]; m_state.pc += 2; 
 }                                                         
 
 // 8xy2
 void Chip8::AND() { 
-    m_V[x] &= m_V[y]; m_pc += 2; 
+    m_state.V[x] &= m_state.V[y]; m_state.pc += 2; 
 }                                                         
 
 // 8xy3
 void Chip8::XOR() { 
-    m_V[x] ^= m_V[y]; m_pc += 2; 
+    m_state.V[x] ^= m_state.V[y]; m_state.pc += 2; 
 }                                                          
 
 // 8xy4
 void Chip8::ADD_VxVy() {
-    m_V[x] += m_V[y];                   
-    m_V[0xF] = (m_V[y] > 0x00F) ? 1 : 0;
-    m_pc += 2;
+    m_state.V[x] += m_state.V[y];                   
+    m_state.V[0xF] = (m_state.V[y] > 0x00F) ? 1 : 0;
+    m_state.pc += 2;
 }                                
 
 // 8xy5
 void Chip8::SUB() {
-    m_V[x] = m_V[x] - m_V[y];            
-    m_V[0xF] = (m_V[x] > m_V[y]) ? 1 : 0;
-    m_pc += 2; 
+    m_state.V[x] = m_state.V[x] - m_state.V[y];            
+    m_state.V[0xF] = (m_state.V[x] > m_state.V[y]) ? 1 : 0;
+    m_state.pc += 2; 
 }                                
 
 // 8xy6
 void Chip8::SHR() {
-    m_V[0xF] = (m_V[x] & 0x01);
-    if (m_V[x] >> 1)
-        m_V[x] >>= 1;
+    m_state.V[0xF] = (m_state.V[x] & 0x01);
+    if (m_state.V[x] >> 1)
+        m_state.V[x] >>= 1;
 
-    m_pc += 2; 
+    m_state.pc += 2; 
 }                                
 
 // 8xy7
 void Chip8::SUBN() {
-    m_V[x] = m_V[y] - m_V[x];             
-    m_V[0xF] = (m_V[x] > m_V[y]) ? 0 : 1;
-    m_pc += 2;  
+    m_state.V[x] = m_state.V[y] - m_state.V[x];             
+    m_state.V[0xF] = (m_state.V[x] > m_state.V[y]) ? 0 : 1;
+    m_state.pc += 2;  
 }                               
 
 // 8xyE
 void Chip8::SHL() {
-    m_V[x] <<= 1;
-    m_V[0xF] = (m_V[x] >> 7);
-    m_pc += 2; 
+    m_state.V[x] <<= 1;
+    m_state.V[0xF] = (m_state.V[x] >> 7);
+    m_state.pc += 2; 
 }                                             
 
 // 9xy0
 void Chip8::SNE_VxVy() { 
-    m_pc += (m_V[x] != m_V[y]) ? 4 : 2; 
+    m_state.pc += (m_state.V[x] != m_state.V[y]) ? 4 : 2; 
 }                                            
 
 // Annn
 void Chip8::LD_I_addr() { 
-    m_index = addr; m_pc += 2; 
+    m_state.index = addr; m_state.pc += 2; 
 }                                                     
 
 // Bnnn
 void Chip8::JP_addrV0() { 
-    m_pc = (addr) + m_V[0]; 
+    m_state.pc = (addr) + m_state.V[0]; 
 }                               
 
 // Cxkk
 void Chip8::RND() { 
-    m_V[x] = (rand() % (0xFF + 1)) & byte; m_pc += 2; 
+    m_state.V[x] = randomByte() & byte; m_state.pc += 2; 
 }                                                       
 
 // Dxyn
 void Chip8::DRW() {
-    uint16_t xPos = m_V[x] % 64;           
-    uint16_t yPos = m_V[y] % 32;
-    uint16_t px;
-
-    m_V[0xF] = 0;
-    for (int i = 0; i < mask; ++i) {
-        px = m_memory[m_index + i];             
-        for(int j = 0; j < 8; ++j) {
-            if((px & (0x80 >> j)) != 0) {
-                if(display[(xPos + j + ((yPos + i) * 64))] == 1)
-                    m_V[0xF] = 1;
-
-                display[xPos + j + ((yPos + i) * 64)] ^= 1;
-            }
-        }
+    uint16_t xPos = m_state.V[x] % 64;           
+    uint16_t yPos = m_state.V[y] % 32;
+    uint64_t hit = 0;
+
+    // each sprite byte is shifted into place and XORed over its whole row at once,
+    // anything past the right or bottom edge is clipped
+    for (int i = 0; i < mask && yPos + i < 32; ++i) {
+        uint64_t row = static_cast<uint64_t>(m_state.memory[(m_state.index + i) & 0xFFF]) << 56 >> xPos;
+        hit |= m_state.display[yPos + i] & row;
+        m_state.display[yPos + i] ^= row;
+        m_dirtyRows |= static_cast<std::uint32_t>(row != 0) << (yPos + i);
+#ifdef CHIP8_PROFILE
+        m_profile.pixels += std::bitset<64>(row).count();
+#endif
     }
+#ifdef CHIP8_PROFILE
+    ++m_profile.draws;
+#endif
+    m_state.V[0xF] = hit != 0;
     drawFlag = true;
-    m_pc += 2; 
+    m_state.pc += 2; 
 } 
 
 // Ex9E
 void Chip8::SKP() { 
-    m_pc += (key[m_V[x]] != 0) ? 4 : 2; 
+    m_state.pc += (m_state.key[m_state.V[x] & 0xF] != 0) ? 4 : 2; 
 }                  
 
 // ExA1
 void Chip8::SKNP() {
-    if (key[m_V[x]] == 0)
-        m_pc += 4;
+    if (m_state.key[m_state.V[x] & 0xF] == 0)
+        m_state.pc += 4;
     else
-        m_pc += 2;
+        m_state.pc += 2;
 }                 
 
 // Fx07
 void Chip8::LD_Vx_t() { 
-    m_V[x] = m_delayTimer; m_pc += 2; 
+    m_state.V[x] = m_state.delayTimer; m_state.pc += 2; 
 }                                                           
 
 // Fx0A
 void Chip8::LD_Vx_k() {
     bool key_pressed = false;
     for(int i = 0; i < 16; ++i) {
-        if(key[i] != 0) {
-            m_V[x] = i;
+        if(m_state.key[i] != 0) {
+            m_state.V[x] = i;
             key_pressed = true;
         }
     }
@@ -393,52 +1153,67 @@ void Chip8::LD_Vx_k() {
     if(!key_pressed)    
         return;
 
-    m_pc += 2; 
+    m_state.pc += 2; 
 }                                                          
 
 // Fx15 & Fx18
 void Chip8::LD_t_Vx(std::uint8_t& timer) { 
-    timer = m_V[x]; m_pc += 2; 
+    timer = m_state.V[x]; m_state.pc += 2; 
 }                                                           
 
+// Fx15
+void Chip8::LD_DT_Vx() { 
+    LD_t_Vx(m_state.delayTimer); 
+}
+
+// Fx18
+void Chip8::LD_ST_Vx() { 
+    LD_t_Vx(m_state.soundTimer); 
+}
+
 // Fx1E        
 void Chip8::ADD_I_Vx() {
-    if(m_index + m_V[x] > 0xFFF)    
-        m_V[0xF] = 1;
+    if(m_state.index + m_state.V[x] > 0xFFF)    
+        m_state.V[0xF] = 1;
     else 
-        m_V[0xF] = 0;
+        m_state.V[0xF] = 0;
 
-    m_index += m_V[x];
-    m_pc += 2; 
+    m_state.index += m_state.V[x];
+    m_state.pc += 2; 
 }            
 
 // Fx29
 void Chip8::LD_F_Vx() { 
-    m_index = m_V[x] * 0x5; m_pc += 2; 
+    m_state.index = m_state.V[x] * 0x5; m_state.pc += 2; 
 }            
 
 // Fx33
 void Chip8::LD_BCD() {
-    m_memory[m_index]     = m_V[x] / 100;
-    m_memory[m_index + 1] = (m_V[x] / 10) % 10;
-    m_memory[m_index + 2] = m_V[x] % 10;
-    m_pc += 2; 
+    m_state.memory[m_state.index & 0xFFF]       = m_state.V[x] / 100;
+    m_state.memory[(m_state.index + 1) & 0xFFF] = (m_state.V[x] / 10) % 10;
+    m_state.memory[(m_state.index + 2) & 0xFFF] = m_state.V[x] % 10;
+
+    for (int i = 0; i < 3; ++i)
+        invalidateDecoded((m_state.index + i) & 0xFFF);
+    m_state.pc += 2; 
 }                  
 
 // Fx55 (write)
 void Chip8::LD_wVF() {
-    for (int i = 0; i <= x; ++i) 
-        m_memory[m_index + i] = m_V[i];
+    for (int i = 0; i <= x; ++i) {
+        m_state.memory[(m_state.index + i) & 0xFFF] = m_state.V[i];
+        invalidateDecoded((m_state.index + i) & 0xFFF);
+    }
 
-    m_index += x + 1;
-    m_pc += 2; 
+    m_state.index += x + 1;
+    m_state.pc += 2; 
 }            
 
 // Fx65 (read)
 void Chip8::LD_rVF() {
     for (int i = 0; i <= x; ++i)
-        m_V[i] = m_memory[m_index + i];
+        m_state.V[i] = m_state.memory[(m_state.index + i) & 0xFFF];
   
-    m_index += x + 1;
-    m_pc += 2; 
+    m_state.index += x + 1;
+    m_state.pc += 2; 
 } 
\ No newline at end of file
@@ -1,43 +1,106 @@
-#include <thread>
+#include <ctime>
+#include <memory>
 #include <emscripten.h>
 
 #include "chip8.hpp"
 #include "gui.hpp"
+#include "rewind.hpp"
+
+// the browser calls mainLoop() once per animation frame, at whatever rate the display refreshes
+// (or slower, in a background tab). emulated time follows the wall clock instead: every call runs
+// the 60 Hz frames that came due since the last one and presents at most once
+constexpr double kFrameMs = 1000.0 / Chip8::kTimerHz;
+constexpr int kMaxFramesPerTick = 4;    // after a longer stall the backlog is dropped, not raced through
 
 Chip8 chip8;
-Gui* gui = nullptr;
+std::unique_ptr<Gui> gui;               // one for the life of the page, created by the first load()
+bool initialized = false;               // gui has its window, renderer and texture
+Rewind history(1024 * 1024);           // keeps the browser heap small, still minutes of history
+Chip8::State previous;
+double lastTick = 0.0;
+double behind = 0.0;                    // wall clock time not emulated yet, in ms
 
 extern "C" {
     void load(char* path) {
-        chip8.loadROM(path);
-        gui = new Gui(1, path, chip8);
+        chip8.enableInputQueue();
+        chip8.loadROM(path, static_cast<std::uint64_t>(std::time(nullptr)));
+        history.clear();
+
+        // the window stays, a running loop carries on with the new ROM
+        if (!gui)
+            gui = std::make_unique<Gui>(1, path);
+        else
+            gui->restart();
     }
 
     void stop() {
         emscripten_cancel_main_loop();
-        gui->cleanup();
+    }
+
+    // instructions per second, at least 60 (one per frame)
+    void setSpeed(int ips) {
+        if (ips >= static_cast<int>(Chip8::kTimerHz))
+            chip8.setClockSpeed(static_cast<unsigned>(ips));
     }
 }
 
 void mainLoop() {
-    // gui isn't ready yet
-    if (!gui->initialize()) {   
+    if (!gui->handleInput(chip8, chip8.state().cycles)) {
+        stop();
         return;
     }
 
-    // cycle through instructions and process user input
-    chip8.cycle();
-    gui->handleInput();
+    double now = emscripten_get_now();
+    behind += now - lastTick;
+    lastTick = now;
 
-    // draw to screen and wait 1ms
-    if (chip8.drawFlag) {
-        gui->updateDisplay();
-        chip8.drawFlag = false;
+    int frames = static_cast<int>(behind / kFrameMs);
+    if (frames > kMaxFramesPerTick) {
+        frames = kMaxFramesPerTick;
+        behind = 0.0;
     }
+    else {
+        behind -= frames * kFrameMs;
+    }
+
+    // each frame runs up to the next timer tick or, while backspace is held, steps one frame back
+    for (int i = 0; i < frames; ++i) {
+        if (gui->rewinding()) {
+            chip8.flushInput();
+            if (history.pop(previous)) {
+                previous.key = chip8.state().key;
+                chip8.loadState(previous);
+            }
+        }
+        else {
+            chip8.runUntilFrame();
+            history.push(chip8.state());
+        }
+    }
+
+    // called every animation frame: it diffs against the frame already shown, so it uploads
+    // nothing and skips the present unless a row changed or the canvas was exposed
+    gui->updateDisplay(chip8.state().display);
+
+    if (chip8.dirtyRows()) {
+        chip8.clearDirtyRows();
+    }
+    chip8.drawFlag = false;
 }
 
 int main() {
+    // no ROM picked yet
+    if (!gui) {
+        return 0;
+    }
+
+    if (!initialized) {
+        gui->initialize();
+        initialized = true;
+    }
+    lastTick = emscripten_get_now();
+    behind = 0.0;
     emscripten_set_main_loop(mainLoop, 0, 0);
-    
+
     return 0;
-}
\ No newline at end of file
+}
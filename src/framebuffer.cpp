@@ -0,0 +1,170 @@
+#include "framebuffer.hpp"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && defined(__SSE2__) && !defined(__EMSCRIPTEN__)
+#define CHIP8_FB_X86 1
+#include <immintrin.h>
+#elif defined(__wasm_simd128__)
+#define CHIP8_FB_SIMD128 1
+#include <wasm_simd128.h>
+#endif
+
+namespace {
+    using RowsFn  = void (*)(const std::uint64_t*, std::size_t, std::uint32_t*, std::size_t, const Framebuffer::Palette&);
+    using BytesFn = void (*)(const std::uint8_t*, std::size_t, std::uint32_t*, const Framebuffer::Palette&);
+
+    struct Kernel {
+        RowsFn      rows;
+        BytesFn     bytes;
+        const char* name;
+    };
+
+    // picks between the two colours without a branch: mask is all ones for foreground
+    inline std::uint32_t select(std::uint32_t mask, const Framebuffer::Palette& p) {
+        return p.background ^ ((p.foreground ^ p.background) & mask);
+    }
+
+    [[maybe_unused]] void rowsScalar(const std::uint64_t* rows, std::size_t count, std::uint32_t* out, std::size_t pitch,
+        const Framebuffer::Palette& p) {
+        for (std::size_t r = 0; r < count; ++r, out += pitch)
+            for (int col = 0; col < 64; ++col)
+                out[col] = select(0u - static_cast<std::uint32_t>((rows[r] >> (63 - col)) & 1), p);
+    }
+
+    void bytesScalar(const std::uint8_t* pixels, std::size_t count, std::uint32_t* out, const Framebuffer::Palette& p) {
+        for (std::size_t i = 0; i < count; ++i)
+            out[i] = select(0u - static_cast<std::uint32_t>(pixels[i] != 0), p);
+    }
+
+#ifdef CHIP8_FB_X86
+    // 4 pixels per vector: the nibble for columns 4n - 4n+3 is broadcast and each lane tests its own bit
+    void rowsSSE2(const std::uint64_t* rows, std::size_t count, std::uint32_t* out, std::size_t pitch,
+        const Framebuffer::Palette& p) {
+        const __m128i fg  = _mm_set1_epi32(static_cast<int>(p.foreground));
+        const __m128i bg  = _mm_set1_epi32(static_cast<int>(p.background));
+        const __m128i bit = _mm_set_epi32(1, 2, 4, 8);
+
+        for (std::size_t r = 0; r < count; ++r, out += pitch) {
+            for (int n = 0; n < 16; ++n) {
+                __m128i nibble = _mm_set1_epi32(static_cast<int>((rows[r] >> (60 - 4 * n)) & 0xF));
+                __m128i lit    = _mm_cmpeq_epi32(_mm_and_si128(nibble, bit), bit);
+                __m128i argb   = _mm_or_si128(_mm_and_si128(lit, fg), _mm_andnot_si128(lit, bg));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * n), argb);
+            }
+        }
+    }
+
+    void bytesSSE2(const std::uint8_t* pixels, std::size_t count, std::uint32_t* out, const Framebuffer::Palette& p) {
+        const __m128i fg   = _mm_set1_epi32(static_cast<int>(p.foreground));
+        const __m128i bg   = _mm_set1_epi32(static_cast<int>(p.background));
+        const __m128i zero = _mm_setzero_si128();
+        std::size_t i = 0;
+
+        for (; i + 4 <= count; i += 4) {
+            std::int32_t packed;
+            std::memcpy(&packed, pixels + i, sizeof(packed));
+            __m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+            __m128i dark = _mm_cmpeq_epi32(wide, zero);
+            __m128i argb = _mm_or_si128(_mm_and_si128(dark, bg), _mm_andnot_si128(dark, fg));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), argb);
+        }
+        bytesScalar(pixels + i, count - i, out + i, p);
+    }
+
+    // 8 pixels per vector, one screen byte at a time
+    __attribute__((target("avx2")))
+    void rowsAVX2(const std::uint64_t* rows, std::size_t count, std::uint32_t* out, std::size_t pitch,
+        const Framebuffer::Palette& p) {
+        const __m256i fg  = _mm256_set1_epi32(static_cast<int>(p.foreground));
+        const __m256i bg  = _mm256_set1_epi32(static_cast<int>(p.background));
+        const __m256i bit = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+        for (std::size_t r = 0; r < count; ++r, out += pitch) {
+            for (int n = 0; n < 8; ++n) {
+                __m256i byte = _mm256_set1_epi32(static_cast<int>((rows[r] >> (56 - 8 * n)) & 0xFF));
+                __m256i lit  = _mm256_cmpeq_epi32(_mm256_and_si256(byte, bit), bit);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8 * n), _mm256_blendv_epi8(bg, fg, lit));
+            }
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void bytesAVX2(const std::uint8_t* pixels, std::size_t count, std::uint32_t* out, const Framebuffer::Palette& p) {
+        const __m256i fg   = _mm256_set1_epi32(static_cast<int>(p.foreground));
+        const __m256i bg   = _mm256_set1_epi32(static_cast<int>(p.background));
+        const __m256i zero = _mm256_setzero_si256();
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            __m256i wide = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels + i)));
+            __m256i dark = _mm256_cmpeq_epi32(wide, zero);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_blendv_epi8(fg, bg, dark));
+        }
+        bytesScalar(pixels + i, count - i, out + i, p);
+    }
+#endif
+
+#ifdef CHIP8_FB_SIMD128
+    void rowsSIMD128(const std::uint64_t* rows, std::size_t count, std::uint32_t* out, std::size_t pitch,
+        const Framebuffer::Palette& p) {
+        const v128_t fg  = wasm_i32x4_splat(static_cast<std::int32_t>(p.foreground));
+        const v128_t bg  = wasm_i32x4_splat(static_cast<std::int32_t>(p.background));
+        const v128_t bit = wasm_i32x4_make(8, 4, 2, 1);
+
+        for (std::size_t r = 0; r < count; ++r, out += pitch) {
+            for (int n = 0; n < 16; ++n) {
+                v128_t nibble = wasm_i32x4_splat(static_cast<std::int32_t>((rows[r] >> (60 - 4 * n)) & 0xF));
+                v128_t lit    = wasm_i32x4_eq(wasm_v128_and(nibble, bit), bit);
+                wasm_v128_store(out + 4 * n, wasm_v128_bitselect(fg, bg, lit));
+            }
+        }
+    }
+
+    void bytesSIMD128(const std::uint8_t* pixels, std::size_t count, std::uint32_t* out, const Framebuffer::Palette& p) {
+        const v128_t fg   = wasm_i32x4_splat(static_cast<std::int32_t>(p.foreground));
+        const v128_t bg   = wasm_i32x4_splat(static_cast<std::int32_t>(p.background));
+        const v128_t zero = wasm_i32x4_splat(0);
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            v128_t half = wasm_u16x8_load8x8(pixels + i);
+            v128_t lo   = wasm_u32x4_extend_low_u16x8(half);
+            v128_t hi   = wasm_u32x4_extend_high_u16x8(half);
+            wasm_v128_store(out + i,     wasm_v128_bitselect(bg, fg, wasm_i32x4_eq(lo, zero)));
+            wasm_v128_store(out + i + 4, wasm_v128_bitselect(bg, fg, wasm_i32x4_eq(hi, zero)));
+        }
+        bytesScalar(pixels + i, count - i, out + i, p);
+    }
+#endif
+
+    Kernel pick() {
+#ifdef CHIP8_FB_X86
+        if (__builtin_cpu_supports("avx2"))
+            return { rowsAVX2, bytesAVX2, "avx2" };
+        return { rowsSSE2, bytesSSE2, "sse2" };
+#elif defined(CHIP8_FB_SIMD128)
+        return { rowsSIMD128, bytesSIMD128, "simd128" };
+#else
+        return { rowsScalar, bytesScalar, "scalar" };
+#endif
+    }
+
+    const Kernel& active() {
+        static const Kernel k = pick();
+        return k;
+    }
+}
+
+void Framebuffer::expandRows(const std::uint64_t* rows, std::size_t count, std::uint32_t* out, std::size_t pitch,
+    const Palette& palette) {
+    active().rows(rows, count, out, pitch, palette);
+}
+
+void Framebuffer::expandBytes(const std::uint8_t* pixels, std::size_t count, std::uint32_t* out, const Palette& palette) {
+    active().bytes(pixels, count, out, palette);
+}
+
+const char* Framebuffer::kernel() {
+    return active().name;
+}
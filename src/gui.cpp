@@ -1,8 +1,13 @@
 #include "gui.hpp"
 
-Gui::Gui(int scale, const std::string& path, Chip8& chip8)
+Gui::Gui(int scale, const std::string& path)
     : romPath(path), m_window(nullptr), m_renderer(nullptr), m_texture(nullptr), 
-        m_scale(scale), m_buffer(2048), m_chip8(chip8) {}
+        m_scale(scale), m_rewinding(false), m_exposed(true), m_shown{}, m_held(0), m_pressedAt{} {
+    // every key in the layout is a printable ASCII keycode, so one table lookup per event
+    m_keymap.fill(-1);
+    for (int i = 0; i < 16; ++i)
+        m_keymap[s_layout[i]] = static_cast<int8_t>(i);
+}
 
 Gui::~Gui() {
     cleanup();
@@ -44,48 +49,110 @@ bool Gui::initialize() {
         32
    );
 
+    // start from a blank texture so only rows that differ from m_shown need uploading
+    std::array<uint32_t, 64 * 32> blank;
+    blank.fill(Framebuffer::kDefaultPalette.background);
+    SDL_UpdateTexture(m_texture, NULL, blank.data(), 64 * sizeof(uint32_t));
+
     return true;
 }
 
-void Gui::handleInput() {
+void Gui::restart() {
+    m_held = 0;
+    m_pressedAt.fill(0);
+}
+
+// a release is held back until the press has been visible for a whole frame, so a tap shorter
+// than a frame still reaches ROMs that only poll the keypad once per frame. events apply in
+// queue order, so anything queued behind it waits too, never more than a frame
+void Gui::queueKey(Chip8& chip8, int key, bool pressed, std::uint64_t cycle) {
+    if (pressed)
+        m_pressedAt[key] = cycle;
+    else
+        cycle = std::max<std::uint64_t>(cycle, m_pressedAt[key] + chip8.cyclesPerFrame());
+
+    if (!chip8.queueKey({ cycle, static_cast<std::uint8_t>(key), pressed }))
+        std::cerr << "[WARN]\t(gui):\t input queue is full, dropped a key event\n";
+}
+
+bool Gui::handleInput(Chip8& chip8, std::uint64_t cycle) {
     SDL_Event e;
     while (SDL_PollEvent(&e)) {
         if (e.type == SDL_QUIT) {
-            exit(0);
+            return false;
         }
 
-        if (e.type == SDL_KEYDOWN) {            // key press             
-            if (e.key.keysym.sym == SDLK_ESCAPE) {
-                exit(0);
-            }   
+        if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_EXPOSED) {
+            m_exposed = true;
+        }
 
-            for (int i = 0; i < 16; ++i) {
-                if (e.key.keysym.sym == m_keypad[i]) {
-                    m_chip8.key.at(i) = 1;     // set state to ON
-                }
-            }
+        if (e.type != SDL_KEYDOWN && e.type != SDL_KEYUP) {
+            continue;
         }
 
-        if (e.type == SDL_KEYUP) {              // key release
-            for (int i = 0; i < 16; ++i) {
-                if (e.key.keysym.sym == m_keypad[i]) {
-                    m_chip8.key.at(i) = 0;     // set state to OFF
-                }
-            }
+        bool pressed = (e.type == SDL_KEYDOWN);
+        SDL_Keycode sym = e.key.keysym.sym;
+
+        if (sym == SDLK_ESCAPE && pressed) {
+            return false;
         }
+
+        if (sym == SDLK_BACKSPACE) {
+            m_rewinding.store(pressed, std::memory_order_relaxed);
+        }
+
+        int key = (sym >= 0 && sym < static_cast<SDL_Keycode>(m_keymap.size())) ? m_keymap[sym] : -1;
+        if (key < 0 || ((m_held >> key & 1) == pressed)) {
+            continue;                           // not a keypad key, or an auto-repeat
+        }
+
+        m_held ^= 1u << key;
+        queueKey(chip8, key, pressed, cycle);
     }
+
+    return true;
 }
 
-void Gui::updateDisplay() {
-    for (int i = 0; i < 2048; ++i) 
-        m_buffer[i] = (0x00FFFFFF * m_chip8.display[i]) | 0xFF000000;
+// rows are compared against m_shown rather than taken from Chip8::dirtyRows(): frames skipped
+// on the way through main.cpp's triple buffer would take their dirty rows with them
+void Gui::updateDisplay(const std::array<uint64_t, 32>& display) {
+    uint32_t changed = 0;
+    for (int row = 0; row < 32; ++row) {
+        if (display[row] != m_shown[row]) {
+            changed |= 1u << row;
+        }
+    }
 
-    SDL_UpdateTexture(
-        m_texture, 
-        NULL, 
-        static_cast<void*>(m_buffer.data()), 
-        64 * sizeof(uint32_t)
-    );
+    // one locked rect per run of changed rows, so a sprite at the top and one at the bottom
+    // don't re-upload everything in between. locked pixels are write-only, so each rect is
+    // rewritten in full
+    for (int first = 0; first < 32; ) {
+        if (!(changed >> first & 1)) {
+            ++first;
+            continue;
+        }
+
+        int end = first;
+        while (end < 32 && (changed >> end & 1)) {
+            ++end;
+        }
+
+        SDL_Rect rect = { 0, first, 64, end - first };
+        void* pixels;
+        int pitch;
+
+        if (SDL_LockTexture(m_texture, &rect, &pixels, &pitch) == 0) {
+            Framebuffer::expandRows(&display[first], end - first, static_cast<uint32_t*>(pixels),
+                pitch / sizeof(uint32_t));
+            std::copy(display.begin() + first, display.begin() + end, m_shown.begin() + first);
+            SDL_UnlockTexture(m_texture);
+        }
+        first = end;
+    }
+
+    if (!changed && !m_exposed) {
+        return;
+    }
 
     SDL_RenderClear(m_renderer);
 
@@ -97,6 +164,7 @@ void Gui::updateDisplay() {
     );
 
     SDL_RenderPresent(m_renderer);
+    m_exposed = false;
 }
 
 void Gui::cleanup() {
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "chip8.hpp"
+#include "trace.hpp"
+
+// runs a ROM without a window at full host speed, for regression and analytics jobs
+
+void handleError(const std::string& message) {
+    std::cerr << "[ERROR]\t(headless):\t " << message << "\n";
+    exit(-1);
+}
+
+void usage() {
+    std::cerr <<
+        "Usage: chip8_headless [options] <path-to-ROM>\n"
+        "  --cycles <n>             stop after n instructions\n"
+        "  --frames <n>             stop after n frames of 1/60 s (default: 600 unless --cycles is given)\n"
+        "  --ips <n>                instructions per second of emulated time (default: 720)\n"
+        "  --keys <file>            scripted input, one '<frame> <key 0-F> <down|up>' per line\n"
+        "  --seed <n>               seed for the RND instruction (default: 0)\n"
+        "  --jit                    use the JIT backend if the host supports it\n"
+        "  --hash                   print a hash of the final framebuffer\n"
+        "  --regs                   print the final registers\n"
+        "  --dump-frames <dir>      write every frame that was drawn to <dir>/frame_<n>.pbm\n"
+        "  --dump-final <file>      write the final framebuffer to a .pbm file\n"
+        "  --load-state <file>      resume from a snapshot instead of starting the ROM from scratch\n"
+        "  --save-state <file>      write a snapshot of the final machine state\n"
+        "  --trace <file>           record every instruction (needs a CHIP8_TRACE build)\n"
+        "  --profile-json <file>    write opcode class / address counters as JSON (needs a CHIP8_PROFILE build)\n"
+        "  --profile-folded <file>  write the same counters as folded stacks for flamegraph.pl\n";
+    exit(-1);
+}
+
+std::uint64_t parseCount(const char* arg) {
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(arg, &end, 10);
+    if (end == arg || *end != '\0')
+        handleError(std::string("Expected a number, got: ") + arg);
+
+    return value;
+}
+
+std::vector<ScriptedKey> loadKeyScript(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open())
+        handleError("Couldn't open key script: " + path);
+
+    std::vector<ScriptedKey> events;
+    std::string line;
+    for (int lineNo = 1; std::getline(file, line); ++lineNo) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::uint64_t frame;
+        std::string key, state;
+
+        if (!(fields >> frame))
+            continue;                                   // blank or comment line
+
+        if (!(fields >> key >> state) || key.size() != 1 || !std::isxdigit(static_cast<unsigned char>(key[0]))
+            || (state != "down" && state != "up"))
+            handleError(path + ":" + std::to_string(lineNo) + ": expected '<frame> <key 0-F> <down|up>'");
+
+        events.push_back({ frame, static_cast<std::uint8_t>(std::stoi(key, nullptr, 16)), state == "down" });
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+        [](const ScriptedKey& a, const ScriptedKey& b) { return a.frame < b.frame; });
+    return events;
+}
+
+// binary PBM (P4): 1 bit per pixel, MSB first, which is exactly the packed row layout
+void writePBM(const Chip8& chip8, const std::string& path) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        handleError("Couldn't write " + path);
+
+    file << "P4\n64 32\n";
+    for (std::uint64_t row : chip8.state().display) {
+        for (int shift = 56; shift >= 0; shift -= 8)
+            file.put(static_cast<char>((row >> shift) & 0xFF));
+    }
+}
+
+void dumpRegisters(const Chip8& chip8) {
+    const Chip8::State& s = chip8.state();
+    std::cout << std::hex << std::uppercase << std::setfill('0');
+    for (int i = 0; i < 16; ++i)
+        std::cout << "V" << i << ": " << std::setw(2) << static_cast<int>(s.V[i]) << ((i % 8 == 7) ? "\n" : "  ");
+
+    std::cout << "PC: " << std::setw(3) << s.pc << "  I: " << std::setw(3) << s.index
+        << "  SP: " << s.sp << "  DT: " << std::setw(2) << static_cast<int>(s.delayTimer)
+        << "  ST: " << std::setw(2) << static_cast<int>(s.soundTimer) << "\n";
+    std::cout << std::dec << std::nouppercase << std::setfill(' ');
+}
+
+int main(int argc, char* argv[]) {
+    std::uint64_t maxCycles = UINT64_MAX;
+    std::uint64_t maxFrames = UINT64_MAX;
+    unsigned ips = Chip8::kDefaultClockSpeed;
+    std::uint64_t seed = Chip8::kDefaultSeed;
+    bool useJit = false, printHash = false, printRegs = false;
+    std::string romPath, keysPath, frameDir, finalPath, loadPath, savePath, tracePath;
+    std::string profileJsonPath, profileFoldedPath;
+
+    // args
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--cycles" && hasValue)
+            maxCycles = parseCount(argv[++i]);
+        else if (arg == "--frames" && hasValue)
+            maxFrames = parseCount(argv[++i]);
+        else if (arg == "--ips" && hasValue)
+            ips = static_cast<unsigned>(parseCount(argv[++i]));
+        else if (arg == "--keys" && hasValue)
+            keysPath = argv[++i];
+        else if (arg == "--seed" && hasValue)
+            seed = parseCount(argv[++i]);
+        else if (arg == "--dump-frames" && hasValue)
+            frameDir = argv[++i];
+        else if (arg == "--dump-final" && hasValue)
+            finalPath = argv[++i];
+        else if (arg == "--load-state" && hasValue)
+            loadPath = argv[++i];
+        else if (arg == "--save-state" && hasValue)
+            savePath = argv[++i];
+        else if (arg == "--trace" && hasValue)
+            tracePath = argv[++i];
+        else if (arg == "--profile-json" && hasValue)
+            profileJsonPath = argv[++i];
+        else if (arg == "--profile-folded" && hasValue)
+            profileFoldedPath = argv[++i];
+        else if (arg == "--jit")
+            useJit = true;
+        else if (arg == "--hash")
+            printHash = true;
+        else if (arg == "--regs")
+            printRegs = true;
+        else if (arg[0] != '-' && romPath.empty())
+            romPath = arg;
+        else
+            usage();
+    }
+
+    if (romPath.empty())
+        usage();
+
+    if (maxCycles == UINT64_MAX && maxFrames == UINT64_MAX)
+        maxFrames = 600;
+
+    if (ips < Chip8::kTimerHz)
+        handleError("Instructions per second must be at least 60");
+
+    std::vector<ScriptedKey> events;
+    if (!keysPath.empty())
+        events = loadKeyScript(keysPath);
+
+    Chip8 chip8;
+    chip8.setClockSpeed(ips);
+
+    if (useJit && !chip8.setBackend(Chip8::Backend::Jit))
+        std::cerr << "[WARN]\t(headless):\t JIT isn't available on this host, using the interpreter\n";
+
+    if (!chip8.loadROM(romPath.c_str(), seed))
+        handleError("Couldn't load ROM");
+
+    std::vector<std::uint8_t> snapshot(Chip8::kSnapshotSize);
+    if (!loadPath.empty()) {
+        std::ifstream file(loadPath, std::ios::binary);
+        file.read(reinterpret_cast<char*>(snapshot.data()), snapshot.size());
+        if (!chip8.loadState(snapshot.data(), static_cast<std::size_t>(file.gcount())))
+            handleError("Not a valid snapshot: " + loadPath);
+    }
+
+#ifdef CHIP8_TRACE
+    std::unique_ptr<TraceWriter> tracer;
+    if (!tracePath.empty()) {
+        tracer = std::make_unique<TraceWriter>(tracePath);
+        if (!tracer->ok())
+            handleError("Couldn't write " + tracePath);
+        chip8.setTracer(tracer.get());
+    }
+#else
+    if (!tracePath.empty())
+        handleError("--trace needs a build configured with -DCHIP8_TRACE=ON");
+#endif
+#ifndef CHIP8_PROFILE
+    if (!profileJsonPath.empty() || !profileFoldedPath.empty())
+        handleError("--profile-json / --profile-folded need a build configured with -DCHIP8_PROFILE=ON");
+#endif
+
+    std::uint64_t cycles = 0, frames = 0;
+    std::size_t nextEvent = 0;
+
+    while (frames < maxFrames && cycles < maxCycles) {
+        // key events take effect at the start of their frame
+        for (; nextEvent < events.size() && events[nextEvent].frame <= frames; ++nextEvent)
+            chip8.setKey(events[nextEvent].key, events[nextEvent].pressed);
+
+        cycles += chip8.runUntilFrame(maxCycles - cycles);
+        if (chip8.state().frameCycles == 0)
+            ++frames;
+
+        if (chip8.drawFlag) {
+            if (!frameDir.empty()) {
+                char name[32];
+                std::snprintf(name, sizeof(name), "/frame_%06llu.pbm", static_cast<unsigned long long>(frames));
+                writePBM(chip8, frameDir + name);
+            }
+            chip8.drawFlag = false;
+        }
+    }
+
+    if (!finalPath.empty())
+        writePBM(chip8, finalPath);
+
+    if (!savePath.empty()) {
+        std::ofstream file(savePath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(snapshot.data()), chip8.saveState(snapshot.data(), snapshot.size()));
+        if (!file)
+            handleError("Couldn't write " + savePath);
+    }
+
+#ifdef CHIP8_PROFILE
+    if (!profileJsonPath.empty()) {
+        std::ofstream file(profileJsonPath);
+        chip8.writeProfileJson(file);
+        if (!file)
+            handleError("Couldn't write " + profileJsonPath);
+    }
+
+    if (!profileFoldedPath.empty()) {
+        std::ofstream file(profileFoldedPath);
+        chip8.writeProfileFolded(file);
+        if (!file)
+            handleError("Couldn't write " + profileFoldedPath);
+    }
+#endif
+
+    std::cout << "cycles: " << cycles << "\nframes: " << frames << "\n";
+    if (printHash)
+        std::cout << "hash: " << std::hex << std::setw(16) << std::setfill('0') << chip8.frameHash()
+            << std::dec << std::setfill(' ') << "\n";
+
+    if (printRegs)
+        dumpRegisters(chip8);
+
+    return 0;
+}
@@ -0,0 +1,469 @@
+#include "jit.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef CHIP8_JIT_AVAILABLE
+#include <sys/mman.h>
+#endif
+
+namespace {
+#ifdef CHIP8_JIT_AVAILABLE
+    constexpr std::size_t kBufferSize = 1 << 20;          // 1 MB of generated code before flushing
+    constexpr std::size_t kPageSize   = 4096;
+#endif
+    constexpr std::size_t kBlockCount = (0x1000 - 0x200) / 2;
+
+    // host registers
+    enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7,
+           R8 = 8, R9, R10, R11, R12, R13, R14, R15 };
+
+    // condition codes for setcc / cmovcc
+    enum { CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7 };
+
+    // registers V0 - VF are allocated from, the callee-saved ones are pushed on entry
+    constexpr int kRegisterPool[] = { RCX, R8, R9, R10, R11, RBX, R12, R13, R14, R15 };
+    constexpr unsigned kPoolSize = sizeof(kRegisterPool) / sizeof(kRegisterPool[0]);
+
+    bool isCalleeSaved(int reg) {
+        return reg == RBX || reg >= R12;
+    }
+
+    // returns false if the opcode has to run in the interpreter. otherwise regs holds the
+    // V registers it touches and terminates is set if it ends the block (jumps and skips)
+    bool classify(std::uint16_t opcode, std::uint16_t& regs, bool& terminates) {
+        const int x = (opcode & 0x0F00) >> 8;
+        const int y = (opcode & 0x00F0) >> 4;
+
+        regs = 0;
+        terminates = false;
+
+        switch (opcode & 0xF000) {
+            case 0x1000:                                // 1nnn : JP addr
+                terminates = true;
+                return true;
+            case 0x3000:                                // 3xkk : SE Vx, byte
+            case 0x4000:                                // 4xkk : SNE Vx, byte
+                regs = 1 << x;
+                terminates = true;
+                return true;
+            case 0x5000:                                // 5xy0 : SE Vx, Vy
+            case 0x9000:                                // 9xy0 : SNE Vx, Vy
+                regs = (1 << x) | (1 << y);
+                terminates = true;
+                return true;
+            case 0x6000:                                // 6xkk : LD Vx, byte
+            case 0x7000:                                // 7xkk : ADD Vx, byte
+                regs = 1 << x;
+                return true;
+            case 0x8000:
+                switch (opcode & 0x000F) {
+                    case 0x0:                           // 8xy0 : LD Vx, Vy
+                    case 0x1:                           // 8xy1 : OR Vx, Vy
+                    case 0x2:                           // 8xy2 : AND Vx, Vy
+                    case 0x3:                           // 8xy3 : XOR Vx, Vy
+                        regs = (1 << x) | (1 << y);
+                        return true;
+                    case 0x4:                           // 8xy4 : ADD Vx, Vy
+                    case 0x5:                           // 8xy5 : SUB Vx, Vy
+                    case 0x7:                           // 8xy7 : SUBN Vx, Vy
+                        regs = (1 << x) | (1 << y) | (1 << 0xF);
+                        return true;
+                    case 0x6:                           // 8xy6 : SHR Vx
+                    case 0xE:                           // 8xyE : SHL Vx
+                        regs = (1 << x) | (1 << 0xF);
+                        return true;
+                }
+                return false;
+            case 0xA000:                                // Annn : LD I, addr
+                return true;
+            case 0xB000:                                // Bnnn : JP V0, addr
+                regs = 1;
+                terminates = true;
+                return true;
+            case 0xF000:
+                switch (opcode & 0x00FF) {
+                    case 0x1E:                          // Fx1E : ADD I, Vx
+                        regs = (1 << x) | (1 << 0xF);
+                        return true;
+                    case 0x29:                          // Fx29 : LD F, Vx
+                        regs = 1 << x;
+                        return true;
+                }
+                return false;
+        }
+
+        return false;
+    }
+}
+
+#ifdef CHIP8_JIT_AVAILABLE
+
+Jit::Jit() : m_blocks(kBlockCount, Block{}), m_buffer(nullptr), m_used(0) {
+    void* buffer = mmap(nullptr, kBufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer != MAP_FAILED)
+        m_buffer = static_cast<std::uint8_t*>(buffer);
+
+    m_code.reserve(1024);
+}
+
+Jit::~Jit() {
+    if (m_buffer)
+        munmap(m_buffer, kBufferSize);
+}
+
+bool Jit::available() {
+    static const bool usable = [] {
+        void* probe = mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (probe == MAP_FAILED)
+            return false;
+
+        bool executable = mprotect(probe, 4096, PROT_READ | PROT_EXEC) == 0;
+        munmap(probe, 4096);
+        return executable;
+    }();
+
+    return usable;
+}
+
+#else
+
+Jit::Jit() : m_blocks(kBlockCount, Block{}), m_buffer(nullptr), m_used(0) {}
+
+Jit::~Jit() {}
+
+bool Jit::available() {
+    return false;
+}
+
+#endif
+
+// returns the compiled block starting at pc, translating it on first use
+const Jit::Block& Jit::lookup(std::uint16_t pc, const std::uint8_t* memory) {
+    Block& block = m_blocks[(pc - 0x200) >> 1];
+    if (!block.translated)
+        block = translate(pc, memory);
+
+    return block;
+}
+
+// drops every block that could contain the instruction at address (self-modifying code).
+// the generated code itself is only reclaimed by flush()
+void Jit::invalidate(std::uint16_t address) {
+    if (address < 0x200 || address >= 0x1000)
+        return;
+
+    std::size_t last  = (address - 0x200) >> 1;
+    std::size_t first = (last >= kMaxBlockLength) ? last - kMaxBlockLength + 1 : 0;
+
+    for (std::size_t i = first; i <= last; ++i) {
+        // untranslatable entries still depend on their own instruction
+        std::size_t end = i + std::max<std::size_t>(m_blocks[i].length, 1);
+        if (m_blocks[i].translated && end > last)
+            m_blocks[i] = Block{};
+    }
+}
+
+void Jit::flush() {
+    std::fill(m_blocks.begin(), m_blocks.end(), Block{});
+    m_used = 0;
+}
+
+Jit::Block Jit::translate(std::uint16_t pc, const std::uint8_t* memory) {
+    Block block{ nullptr, 0, true };
+    if (!m_buffer)
+        return block;
+
+    // pass 1: find the compilable prefix and give each V register it touches a host register
+    std::uint16_t opcodes[kMaxBlockLength];
+    int host[16];
+    std::fill(host, host + 16, -1);
+
+    unsigned allocated = 0;
+    unsigned length = 0;
+    bool terminated = false;
+
+    while (length < kMaxBlockLength && pc + 2 * length < 0xFFF) {
+        std::uint16_t address = pc + 2 * length;
+        std::uint16_t opcode  = memory[address] << 8 | memory[address + 1];
+        std::uint16_t regs;
+        bool terminates;
+
+        if (!classify(opcode, regs, terminates))
+            break;
+
+        unsigned needed = 0;
+        for (int v = 0; v < 16; ++v)
+            if ((regs & (1 << v)) && host[v] < 0)
+                ++needed;
+
+        if (allocated + needed > kPoolSize)
+            break;
+
+        for (int v = 0; v < 16; ++v)
+            if ((regs & (1 << v)) && host[v] < 0)
+                host[v] = kRegisterPool[allocated++];
+
+        opcodes[length++] = opcode;
+        if (terminates) {
+            terminated = true;
+            break;
+        }
+    }
+
+    if (length == 0)
+        return block;
+
+    // pass 2: emit code. SysV: rdi = V, rsi = &I, eax = next PC
+    m_code.clear();
+
+    for (unsigned i = 0; i < allocated; ++i)
+        if (isCalleeSaved(kRegisterPool[i]))
+            emitPush(kRegisterPool[i]);
+
+    for (int v = 0; v < 16; ++v)
+        if (host[v] >= 0)
+            emitLoadV(host[v], v);
+
+    for (unsigned i = 0; i < length; ++i) {
+        const std::uint16_t opcode  = opcodes[i];
+        const std::uint16_t address = pc + 2 * i;
+        const std::uint16_t nnn     = opcode & 0x0FFF;
+        const std::uint8_t  kk      = opcode & 0x00FF;
+        const int vx = host[(opcode & 0x0F00) >> 8];
+        const int vy = host[(opcode & 0x00F0) >> 4];
+        const int vf = host[0xF];
+
+        switch (opcode & 0xF000) {
+            case 0x1000:                                // eax = nnn
+                emit(0xB8); emit32(nnn);
+                break;
+            case 0x3000:                                // eax = (Vx == kk) ? pc + 4 : pc + 2
+            case 0x4000:
+                emit(0xB8); emit32(address + 2);
+                emit(0xBA); emit32(address + 4);
+                emitGroup1Imm8(7, vx, kk);
+                emit(0x0F); emit(0x40 + ((opcode & 0xF000) == 0x3000 ? CC_E : CC_NE)); emit(0xC2);
+                break;
+            case 0x5000:                                // eax = (Vx == Vy) ? pc + 4 : pc + 2
+            case 0x9000:
+                emit(0xB8); emit32(address + 2);
+                emit(0xBA); emit32(address + 4);
+                emitOp8(0x38, vx, vy);
+                emit(0x0F); emit(0x40 + ((opcode & 0xF000) == 0x5000 ? CC_E : CC_NE)); emit(0xC2);
+                break;
+            case 0x6000:                                // Vx = kk
+                emitMovImm8(vx, kk);
+                break;
+            case 0x7000:                                // Vx += kk
+                emitGroup1Imm8(0, vx, kk);
+                break;
+            case 0x8000:
+                switch (opcode & 0x000F) {
+                    case 0x0:                           // Vx = Vy
+                        emitOp8(0x88, vx, vy);
+                        break;
+                    case 0x1:                           // Vx |= Vy
+                        emitOp8(0x08, vx, vy);
+                        break;
+                    case 0x2:                           // Vx &= Vy
+                        emitOp8(0x20, vx, vy);
+                        break;
+                    case 0x3:                           // Vx ^= Vy
+                        emitOp8(0x30, vx, vy);
+                        break;
+                    case 0x4:                           // Vx += Vy, VF = Vy > 0xF
+                        emitOp8(0x00, vx, vy);
+                        emitGroup1Imm8(7, vy, 0x0F);
+                        emitSetcc(CC_A, vf);
+                        break;
+                    case 0x5:                           // Vx -= Vy, VF = Vx > Vy
+                        emitOp8(0x28, vx, vy);
+                        emitOp8(0x38, vx, vy);
+                        emitSetcc(CC_A, vf);
+                        break;
+                    case 0x6:                           // VF = Vx & 1, Vx >>= 1 unless that gives 0
+                        emitOp8(0x88, RAX, vx);
+                        emitGroup1Imm8(4, RAX, 0x01);
+                        emitOp8(0x88, vf, RAX);
+                        emitOp8(0x88, RAX, vx);
+                        emitShift8(5, RAX, 1);
+                        emit(0x74); emit(0x03);         // jz over the 3 byte mov below
+                        emitOp8(0x88, vx, RAX);
+                        break;
+                    case 0x7:                           // Vx = Vy - Vx, VF = Vx <= Vy
+                        emitOp8(0x88, RAX, vy);
+                        emitOp8(0x28, RAX, vx);
+                        emitOp8(0x88, vx, RAX);
+                        emitOp8(0x38, vx, vy);
+                        emitSetcc(CC_BE, vf);
+                        break;
+                    case 0xE:                           // Vx <<= 1, VF = Vx >> 7
+                        emitShift8(4, vx, 1);
+                        emitOp8(0x88, RAX, vx);
+                        emitShift8(5, RAX, 7);
+                        emitOp8(0x88, vf, RAX);
+                        break;
+                }
+                break;
+            case 0xA000:                                // I = nnn
+                emit(0x66); emit(0xC7); emit(0x06); emit16(nnn);
+                break;
+            case 0xB000:                                // eax = nnn + V0
+                emitMovzx8(RAX, host[0]);
+                emit(0x05); emit32(nnn);
+                break;
+            case 0xF000:
+                if ((opcode & 0x00FF) == 0x1E) {        // VF = I + Vx > 0xFFF, I += Vx
+                    emit(0x0F); emit(0xB7); emit(0x06); // movzx eax, word [rsi]
+                    emitMovzx8(RDX, vx);
+                    emit(0x01); emit(0xD0);             // add eax, edx
+                    emit(0x3D); emit32(0xFFF);          // cmp eax, 0xFFF
+                    emitSetcc(CC_A, vf);
+                    emitMovzx8(RDX, vx);                // Vx may have been VF
+                    emit(0x0F); emit(0xB7); emit(0x06);
+                    emit(0x01); emit(0xD0);
+                    emit(0x66); emit(0x89); emit(0x06); // mov [rsi], ax
+                }
+                else {                                  // I = Vx * 5
+                    emitMovzx8(RAX, vx);
+                    emit(0x8D); emit(0x04); emit(0x80); // lea eax, [rax + rax * 4]
+                    emit(0x66); emit(0x89); emit(0x06);
+                }
+                break;
+        }
+    }
+
+    if (!terminated) {                                  // fell off the end of the block
+        emit(0xB8); emit32(pc + 2 * length);
+    }
+
+    for (int v = 0; v < 16; ++v)
+        if (host[v] >= 0)
+            emitStoreV(host[v], v);
+
+    for (unsigned i = allocated; i-- > 0;)
+        if (isCalleeSaved(kRegisterPool[i]))
+            emitPop(kRegisterPool[i]);
+
+    emit(0xC3);                                         // ret
+
+#ifdef CHIP8_JIT_AVAILABLE
+    if (m_used + m_code.size() > kBufferSize)
+        flush();
+
+    // keep the buffer W^X: only the pages the new block lands on are writable, and only while copying
+    std::uint8_t* entry = m_buffer + m_used;
+    std::size_t pageFirst = m_used & ~(kPageSize - 1);
+    std::size_t pageEnd   = (m_used + m_code.size() + kPageSize - 1) & ~(kPageSize - 1);
+
+    if (mprotect(m_buffer + pageFirst, pageEnd - pageFirst, PROT_READ | PROT_WRITE) != 0)
+        return block;
+
+    std::memcpy(entry, m_code.data(), m_code.size());
+    m_used += (m_code.size() + 15) & ~static_cast<std::size_t>(15);
+
+    if (mprotect(m_buffer + pageFirst, pageEnd - pageFirst, PROT_READ | PROT_EXEC) != 0)
+        return block;
+
+    block.fn = reinterpret_cast<BlockFn>(entry);
+    block.length = static_cast<std::uint8_t>(length);
+#endif
+
+    return block;
+}
+
+void Jit::emit(std::uint8_t b) {
+    m_code.push_back(b);
+}
+
+void Jit::emit16(std::uint16_t v) {
+    emit(v & 0xFF);
+    emit(v >> 8);
+}
+
+void Jit::emit32(std::uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+        emit((v >> (8 * i)) & 0xFF);
+}
+
+// a REX prefix is always emitted for byte ops, so encodings 4 - 7 mean spl/bpl/sil/dil.
+// those are never handed out as V registers
+void Jit::emitRex(bool wide, int reg, int rm) {
+    emit(0x40 | (wide ? 0x08 : 0) | ((reg >> 3) & 1) << 2 | ((rm >> 3) & 1));
+}
+
+// <op> r/m8, r8  (rm is the destination)
+void Jit::emitOp8(std::uint8_t opcode, int rm, int reg) {
+    emitRex(false, reg, rm);
+    emit(opcode);
+    emit(0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// mov r8, imm8
+void Jit::emitMovImm8(int reg, std::uint8_t imm) {
+    emitRex(false, 0, reg);
+    emit(0xB0 + (reg & 7));
+    emit(imm);
+}
+
+// add (0) / and (4) / cmp (7) r/m8, imm8
+void Jit::emitGroup1Imm8(int ext, int reg, std::uint8_t imm) {
+    emitRex(false, 0, reg);
+    emit(0x80);
+    emit(0xC0 | ext << 3 | (reg & 7));
+    emit(imm);
+}
+
+// shl (4) / shr (5) r/m8, count
+void Jit::emitShift8(int ext, int reg, std::uint8_t count) {
+    emitRex(false, 0, reg);
+    emit(count == 1 ? 0xD0 : 0xC0);
+    emit(0xC0 | ext << 3 | (reg & 7));
+    if (count != 1)
+        emit(count);
+}
+
+void Jit::emitSetcc(int cc, int reg) {
+    emitRex(false, 0, reg);
+    emit(0x0F);
+    emit(0x90 + cc);
+    emit(0xC0 | (reg & 7));
+}
+
+// movzx r32, r8
+void Jit::emitMovzx8(int dst, int src) {
+    emitRex(false, dst, src);
+    emit(0x0F);
+    emit(0xB6);
+    emit(0xC0 | (dst & 7) << 3 | (src & 7));
+}
+
+// movzx r32, byte [rdi + v]
+void Jit::emitLoadV(int reg, int v) {
+    emitRex(false, reg, RDI);
+    emit(0x0F);
+    emit(0xB6);
+    emit(0x40 | (reg & 7) << 3 | (RDI & 7));
+    emit(v);
+}
+
+// mov byte [rdi + v], r8
+void Jit::emitStoreV(int reg, int v) {
+    emitRex(false, reg, RDI);
+    emit(0x88);
+    emit(0x40 | (reg & 7) << 3 | (RDI & 7));
+    emit(v);
+}
+
+void Jit::emitPush(int reg) {
+    if (reg >= R8)
+        emit(0x41);
+    emit(0x50 + (reg & 7));
+}
+
+void Jit::emitPop(int reg) {
+    if (reg >= R8)
+        emit(0x41);
+    emit(0x58 + (reg & 7));
+}
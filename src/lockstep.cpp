@@ -0,0 +1,426 @@
+#include "lockstep.hpp"
+
+#include <algorithm>
+
+// the per-lane loops below are plain C++. one clone of step() per vector ISA (AVX-512BW by way
+// of skylake-avx512, AVX2) lets the loader pick the widest one the host has
+#if defined(__x86_64__) && defined(__GNUC__) && defined(__linux__) && !defined(__EMSCRIPTEN__)
+#define LOCKSTEP_CLONES __attribute__((target_clones("arch=skylake-avx512", "avx2", "default")))
+#else
+#define LOCKSTEP_CLONES
+#endif
+
+Lockstep::Lockstep(std::size_t lanes, unsigned clockSpeed)
+    : m_lanes(lanes), m_stride((lanes + kBlock - 1) / kBlock * kBlock), m_count(0), m_clockSpeed(clockSpeed),
+        m_pc(0x200), m_sp(0), m_frameCycles(0), m_cycles(0), m_stack{}, m_memory{},
+        m_V(16 * m_stride), m_index(m_stride), m_delayTimer(m_stride), m_soundTimer(m_stride),
+        m_key(16 * m_stride), m_rng(m_stride), m_display(32 * m_stride), m_laneOf(m_stride),
+        m_slotOf(lanes, kScalar), m_scalar(lanes) {
+    Chip8 probe;
+    probe.setClockSpeed(clockSpeed);
+    m_cyclesPerFrame = probe.cyclesPerFrame();
+}
+
+Lockstep::~Lockstep() {}
+
+bool Lockstep::loadROM(const std::uint8_t* data, std::size_t size, const std::vector<std::uint64_t>& seeds) {
+    m_count = 0;
+    m_image = Chip8::loadImage(data, size);
+    if (!m_image)
+        return false;
+
+    // every lane starts out as a fresh Chip8 would, only the seeded RND state differs
+    Chip8 chip8;
+    Chip8::State state;
+    chip8.loadROM(m_image);
+    chip8.saveState(state);
+
+    for (std::size_t lane = 0; lane < m_lanes; ++lane) {
+        state.rng = Chip8::rngState(lane < seeds.size() ? seeds[lane] : Chip8::kDefaultSeed);
+        scatter(lane, state);
+        m_laneOf[lane] = static_cast<std::uint32_t>(lane);
+        m_slotOf[lane] = static_cast<std::uint32_t>(lane);
+        m_scalar[lane].reset();
+    }
+
+    m_count = m_lanes;
+    m_pc = state.pc;
+    m_sp = state.sp;
+    m_frameCycles = state.frameCycles;
+    m_cycles = state.cycles;
+    m_stack = state.stack;
+    m_memory = state.memory;
+    return true;
+}
+
+void Lockstep::setKey(std::size_t lane, std::uint8_t key, bool pressed) {
+    if (m_scalar[lane])
+        m_scalar[lane]->setKey(key, pressed);
+    else
+        m_key[(key & 0xF) * m_stride + m_slotOf[lane]] = pressed ? 1 : 0;
+}
+
+void Lockstep::saveState(std::size_t lane, Chip8::State& out) const {
+    if (m_scalar[lane])
+        m_scalar[lane]->saveState(out);
+    else
+        gather(m_slotOf[lane], out);
+}
+
+bool Lockstep::faulted(std::size_t lane) const {
+    return m_scalar[lane] && m_scalar[lane]->faulted();
+}
+
+void Lockstep::gather(std::size_t slot, Chip8::State& out) const {
+    out = Chip8::State{};
+    for (std::size_t i = 0; i < 16; ++i) {
+        out.V[i]   = m_V[i * m_stride + slot];
+        out.key[i] = m_key[i * m_stride + slot];
+    }
+    for (std::size_t row = 0; row < 32; ++row)
+        out.display[row] = m_display[row * m_stride + slot];
+
+    out.pc          = m_pc;
+    out.index       = m_index[slot];
+    out.sp          = m_sp;
+    out.delayTimer  = m_delayTimer[slot];
+    out.soundTimer  = m_soundTimer[slot];
+    out.frameCycles = m_frameCycles;
+    out.cycles      = m_cycles;
+    out.rng         = m_rng[slot];
+    out.stack       = m_stack;
+    out.memory      = m_memory;
+}
+
+// the per-slot half of a State, the shared half is set by the caller
+void Lockstep::scatter(std::size_t slot, const Chip8::State& in) {
+    for (std::size_t i = 0; i < 16; ++i) {
+        m_V[i * m_stride + slot]   = in.V[i];
+        m_key[i * m_stride + slot] = in.key[i];
+    }
+    for (std::size_t row = 0; row < 32; ++row)
+        m_display[row * m_stride + slot] = in.display[row];
+
+    m_index[slot]      = in.index;
+    m_delayTimer[slot] = in.delayTimer;
+    m_soundTimer[slot] = in.soundTimer;
+    m_rng[slot]        = in.rng;
+}
+
+void Lockstep::moveSlot(std::size_t from, std::size_t to) {
+    Chip8::State state;
+    gather(from, state);
+    scatter(to, state);
+
+    m_laneOf[to] = m_laneOf[from];
+    m_slotOf[m_laneOf[to]] = static_cast<std::uint32_t>(to);
+}
+
+// hands the lane in this slot over to its own Chip8, the last slot fills the hole
+void Lockstep::evict(std::size_t slot) {
+    std::uint32_t lane = m_laneOf[slot];
+    Chip8::State state;
+    gather(slot, state);
+
+    // starting from the shared image, only pages the group has written since get copied
+    m_scalar[lane] = std::make_unique<Chip8>();
+    m_scalar[lane]->setClockSpeed(m_clockSpeed);
+    m_scalar[lane]->loadROM(m_image);
+    m_scalar[lane]->loadState(state);
+    m_slotOf[lane] = kScalar;
+
+    if (slot != --m_count)
+        moveSlot(m_count, slot);
+}
+
+// whole blocks, so the inner loop has a fixed trip count. slots past m_count hold stale lanes
+// that nothing reads back
+template <typename F>
+inline void Lockstep::forLanes(F f) {
+    for (std::size_t base = 0; base < m_count; base += kBlock)
+        for (std::size_t slot = base; slot < base + kBlock; ++slot)
+            f(slot);
+}
+
+// downwards, so the slot moved into a hole has already been looked at
+template <typename F>
+inline void Lockstep::evictIf(F pred) {
+    for (std::size_t slot = m_count; slot-- > 0;)
+        if (pred(slot))
+            evict(slot);
+}
+
+// the group goes the way slot 0 goes, every lane that wouldn't is evicted. returns slot 0's outcome
+template <typename F>
+inline auto Lockstep::follow(F outcome) {
+    const auto lead = outcome(0);
+    bool split = false;
+    for (std::size_t slot = 1; slot < m_count; ++slot)
+        split |= outcome(slot) != lead;
+
+    if (split)
+        evictIf([&](std::size_t slot) { return outcome(slot) != lead; });
+    return lead;
+}
+
+std::uint64_t Lockstep::runUntilFrame() {
+    std::uint64_t executed = 0;
+
+    while (m_count > 0) {
+        step();
+        if (m_count == 0)
+            break;
+
+        executed += m_count;
+        ++m_cycles;
+        if (++m_frameCycles >= m_cyclesPerFrame) {
+            m_frameCycles = 0;
+            tick();
+            break;
+        }
+    }
+
+    // lanes evicted this frame pick up where the group left them
+    for (const auto& chip8 : m_scalar)
+        if (chip8)
+            executed += chip8->runUntilFrame(UINT64_MAX);
+
+    return executed;
+}
+
+void Lockstep::tick() {
+    std::uint8_t* delay = m_delayTimer.data();
+    std::uint8_t* sound = m_soundTimer.data();
+    forLanes([&](std::size_t l) {
+        delay[l] -= delay[l] > 0;
+        sound[l] -= sound[l] > 0;
+    });
+}
+
+// one instruction for every lane in the group, each case mirrors the Chip8 handler of the
+// same name. lanes that would leave the group are evicted before anything is changed
+LOCKSTEP_CLONES
+void Lockstep::step() {
+    const std::uint16_t opcode = m_memory[m_pc & 0xFFF] << 8 | m_memory[(m_pc + 1) & 0xFFF];
+    const std::uint16_t addr = opcode & 0x0FFF;
+    const std::uint8_t  byte = opcode & 0x00FF;
+    const std::uint8_t  n    = opcode & 0x000F;
+    const std::uint8_t  x    = (opcode & 0x0F00) >> 8;
+    const std::uint8_t  y    = (opcode & 0x00F0) >> 4;
+    const std::uint8_t  handler = Chip8::opcodeTable()[opcode];
+
+    std::uint8_t*  Vx    = V(x);
+    std::uint8_t*  Vy    = V(y);
+    std::uint8_t*  VF    = V(0xF);
+    std::uint16_t* index = m_index.data();
+
+    switch (handler) {
+        case Chip8::op_CLS:
+            for (std::size_t row = 0; row < 32; ++row)
+                std::fill_n(display(row), m_count, 0);
+            m_pc += 2;
+            break;
+        case Chip8::op_RET:
+            --m_sp;
+            m_pc = m_stack[m_sp & 0xF] + 2;
+            break;
+        case Chip8::op_JP_addr:
+            m_pc = addr;
+            break;
+        case Chip8::op_CALL:
+            m_stack[m_sp & 0xF] = m_pc;
+            ++m_sp;
+            m_pc = addr;
+            break;
+        case Chip8::op_SE_Vx_byte:
+            m_pc += follow([&](std::size_t l) { return Vx[l] == byte; }) ? 4 : 2;
+            break;
+        case Chip8::op_SNE_Vx_byte:
+            m_pc += follow([&](std::size_t l) { return Vx[l] != byte; }) ? 4 : 2;
+            break;
+        case Chip8::op_SE_VxVy:
+            m_pc += follow([&](std::size_t l) { return Vx[l] == Vy[l]; }) ? 4 : 2;
+            break;
+        case Chip8::op_SNE_VxVy:
+            m_pc += follow([&](std::size_t l) { return Vx[l] != Vy[l]; }) ? 4 : 2;
+            break;
+        case Chip8::op_LD_Vx_byte:
+            forLanes([&](std::size_t l) { Vx[l] = byte; });
+            m_pc += 2;
+            break;
+        case Chip8::op_ADD_Vx_byte:
+            forLanes([&](std::size_t l) { Vx[l] += byte; });
+            m_pc += 2;
+            break;
+        case Chip8::op_LD_VxVy:
+            forLanes([&](std::size_t l) { Vx[l] = Vy[l]; });
+            m_pc += 2;
+            break;
+        case Chip8::op_OR:
+            forLanes([&](std::size_t l) { Vx[l] |= Vy[l]; });
+            m_pc += 2;
+            break;
+        case Chip8::op_AND:
+            forLanes([&](std::size_t l) { Vx[l] &= Vy[l]; });
+            m_pc += 2;
+            break;
+        case Chip8::op_XOR:
+            forLanes([&](std::size_t l) { Vx[l] ^= Vy[l]; });
+            m_pc += 2;
+            break;
+        case Chip8::op_ADD_VxVy:
+            forLanes([&](std::size_t l) {
+                Vx[l] += Vy[l];
+                VF[l] = Vy[l] > 0x00F;
+            });
+            m_pc += 2;
+            break;
+        case Chip8::op_SUB:
+            forLanes([&](std::size_t l) {
+                Vx[l] = Vx[l] - Vy[l];
+                VF[l] = Vx[l] > Vy[l];
+            });
+            m_pc += 2;
+            break;
+        case Chip8::op_SHR:
+            forLanes([&](std::size_t l) {
+                VF[l] = Vx[l] & 0x01;
+                if (Vx[l] >> 1)
+                    Vx[l] >>= 1;
+            });
+            m_pc += 2;
+            break;
+        case Chip8::op_SUBN:
+            forLanes([&](std::size_t l) {
+                Vx[l] = Vy[l] - Vx[l];
+                VF[l] = Vx[l] <= Vy[l];
+            });
+            m_pc += 2;
+            break;
+        case Chip8::op_SHL:
+            forLanes([&](std::size_t l) {
+                Vx[l] <<= 1;
+                VF[l] = Vx[l] >> 7;
+            });
+            m_pc += 2;
+            break;
+        case Chip8::op_LD_I_addr:
+            forLanes([&](std::size_t l) { index[l] = addr; });
+            m_pc += 2;
+            break;
+        case Chip8::op_JP_addrV0: {
+            std::uint8_t* V0 = V(0);
+            m_pc = addr + follow([&](std::size_t l) { return V0[l]; });
+            break;
+        }
+        case Chip8::op_RND: {
+            std::uint64_t* rng = m_rng.data();
+            forLanes([&](std::size_t l) {
+                rng[l] ^= rng[l] >> 12;
+                rng[l] ^= rng[l] << 25;
+                rng[l] ^= rng[l] >> 27;
+                Vx[l] = static_cast<std::uint8_t>((rng[l] * 0x2545F4914F6CDD1DULL) >> 56) & byte;
+            });
+            m_pc += 2;
+            break;
+        }
+        case Chip8::op_DRW:
+            // every lane draws at its own position, so this one stays a plain loop
+            for (std::size_t l = 0; l < m_count; ++l) {
+                std::uint16_t xPos = Vx[l] % 64;
+                std::uint16_t yPos = Vy[l] % 32;
+                std::uint64_t hit = 0;
+
+                for (int i = 0; i < n && yPos + i < 32; ++i) {
+                    std::uint64_t row = static_cast<std::uint64_t>(m_memory[(index[l] + i) & 0xFFF]) << 56 >> xPos;
+                    std::uint64_t& pixels = display(yPos + i)[l];
+                    hit |= pixels & row;
+                    pixels ^= row;
+                }
+                VF[l] = hit != 0;
+            }
+            m_pc += 2;
+            break;
+        case Chip8::op_SKP:
+        case Chip8::op_SKNP: {
+            bool pressed = follow([&](std::size_t l) { return m_key[(Vx[l] & 0xF) * m_stride + l] != 0; });
+            m_pc += (pressed == (handler == Chip8::op_SKP)) ? 4 : 2;
+            break;
+        }
+        case Chip8::op_LD_Vx_t: {
+            std::uint8_t* delay = m_delayTimer.data();
+            forLanes([&](std::size_t l) { Vx[l] = delay[l]; });
+            m_pc += 2;
+            break;
+        }
+        case Chip8::op_LD_Vx_k: {
+            bool any = follow([&](std::size_t l) {
+                bool down = false;
+                for (std::size_t k = 0; k < 16; ++k)
+                    down |= m_key[k * m_stride + l] != 0;
+                return down;
+            });
+            if (!any)
+                break;                          // waits here, like the scalar core
+
+            for (std::uint8_t k = 0; k < 16; ++k) {
+                const std::uint8_t* down = key(k);
+                forLanes([&](std::size_t l) { Vx[l] = down[l] ? k : Vx[l]; });
+            }
+            m_pc += 2;
+            break;
+        }
+        case Chip8::op_LD_DT_Vx:
+        case Chip8::op_LD_ST_Vx: {
+            std::uint8_t* timer = (handler == Chip8::op_LD_DT_Vx) ? m_delayTimer.data() : m_soundTimer.data();
+            forLanes([&](std::size_t l) { timer[l] = Vx[l]; });
+            m_pc += 2;
+            break;
+        }
+        case Chip8::op_ADD_I_Vx:
+            forLanes([&](std::size_t l) {
+                VF[l] = index[l] + Vx[l] > 0xFFF;
+                index[l] += Vx[l];
+            });
+            m_pc += 2;
+            break;
+        case Chip8::op_LD_F_Vx:
+            forLanes([&](std::size_t l) { index[l] = Vx[l] * 0x5; });
+            m_pc += 2;
+            break;
+        case Chip8::op_LD_BCD: {
+            // memory is shared, so only lanes writing the same bytes to the same place stay
+            evictIf([&](std::size_t l) { return index[l] != index[0] || Vx[l] != Vx[0]; });
+            m_memory[index[0] & 0xFFF]       = Vx[0] / 100;
+            m_memory[(index[0] + 1) & 0xFFF] = (Vx[0] / 10) % 10;
+            m_memory[(index[0] + 2) & 0xFFF] = Vx[0] % 10;
+            m_pc += 2;
+            break;
+        }
+        case Chip8::op_LD_wVF: {
+            evictIf([&](std::size_t l) {
+                bool differs = index[l] != index[0];
+                for (std::size_t i = 0; i <= x; ++i)
+                    differs |= m_V[i * m_stride + l] != m_V[i * m_stride];
+                return differs;
+            });
+            for (std::size_t i = 0; i <= x; ++i)
+                m_memory[(index[0] + i) & 0xFFF] = V(i)[0];
+            forLanes([&](std::size_t l) { index[l] += x + 1; });
+            m_pc += 2;
+            break;
+        }
+        case Chip8::op_LD_rVF:
+            for (std::size_t i = 0; i <= x; ++i) {
+                std::uint8_t* Vi = V(i);
+                forLanes([&](std::size_t l) { Vi[l] = m_memory[(index[l] + i) & 0xFFF]; });
+            }
+            forLanes([&](std::size_t l) { index[l] += x + 1; });
+            m_pc += 2;
+            break;
+        default:
+            // invalid opcode, the scalar cores report it
+            evictIf([](std::size_t) { return true; });
+            break;
+    }
+}
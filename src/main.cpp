@@ -1,9 +1,15 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ctime>
 #include <iostream>
 #include <memory>
 #include <thread>
 
 #include "chip8.hpp"
 #include "gui.hpp"
+#include "rewind.hpp"
+#include "triple_buffer.hpp"
 
 void handleError(const char* message) {
     std::cerr << "[ERROR]\t(main):\t " << message << "\n";
@@ -11,40 +17,111 @@ void handleError(const char* message) {
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        handleError("Invalid arguments were provided\nUsage: <display-scale> <path-to-ROM>");
+    if (argc != 3 && argc != 4) {
+        handleError("Invalid arguments were provided\nUsage: <display-scale> <path-to-ROM> [instructions-per-second, 0 = unlimited]");
     }
 
     // args
     int scale = atoi(argv[1]);
     std::string romPath = argv[2];
+    int ips = (argc == 4) ? atoi(argv[3]) : static_cast<int>(Chip8::kDefaultClockSpeed);
 
     if (scale <= 0) {
         handleError("Display scale must be at least 1");
     }
 
+    if (ips < 0) {
+        handleError("Instructions per second can't be negative");
+    }
+
     Chip8 chip8;
+    chip8.enableInputQueue();           // gui queues keys from this thread while the emulation thread runs
+    if (ips > 0) {
+        chip8.setClockSpeed(ips);
+    }
 
-    if (!chip8.loadROM(romPath.c_str())) {
+    // a new RND sequence on every launch, like the original hardware
+    if (!chip8.loadROM(romPath.c_str(), static_cast<std::uint64_t>(std::time(nullptr)))) {
         handleError("Couldn't load ROM");
     }
 
-    Gui gui(scale, romPath, chip8);
+    Gui gui(scale, romPath);
 
     if (!gui.initialize()) {
         handleError("Couldn't initialize GUI");
     }
 
-    while (true) {
-        // cycle through instructions and process user input
-        chip8.cycle();
-        gui.handleInput();
+    using clock = std::chrono::steady_clock;
+    const auto frameTime = std::chrono::microseconds(1000000 / Chip8::kTimerHz);
+
+    // emulation runs on its own thread so a slow present (vsync, compositor stalls) can't hold it
+    // up. it hands finished screens to this thread through `frames` and publishes its cycle count
+    // for stamping key events, which come back through chip8's input queue. backspace is read
+    // from gui's atomic, nothing else is shared
+    TripleBuffer<std::array<uint64_t, 32>> frames;
+    std::atomic<std::uint64_t> emulated(chip8.state().cycles);
+    std::atomic<bool> running(true);
+
+    std::thread emulation([&] {
+        Rewind history;
+        Chip8::State previous;
+        auto deadline = clock::now();
+
+        while (running.load(std::memory_order_relaxed)) {
+            // run one frame (up to the next 60 Hz timer tick) or, while backspace is held, step
+            // one frame back. the keypad isn't part of the history
+            bool rewinding = gui.rewinding();
+            if (rewinding) {
+                chip8.flushInput();
+                if (history.pop(previous)) {
+                    previous.key = chip8.state().key;
+                    chip8.loadState(previous);
+                }
+            }
+            else {
+                chip8.runUntilFrame();
+                history.push(chip8.state());
+            }
+            emulated.store(chip8.state().cycles, std::memory_order_relaxed);
 
-        // draw to screen
-        if (chip8.drawFlag) {
-            gui.updateDisplay();
-            chip8.drawFlag = false;
+            if (chip8.dirtyRows()) {
+                frames.back() = chip8.state().display;
+                frames.publish();
+                chip8.clearDirtyRows();
+                chip8.drawFlag = false;
+            }
+
+            // when unlimited, frames run back to back. rewinding is always paced, or holding
+            // backspace would empty the history in a few milliseconds
+            if (ips == 0 && !rewinding)
+                continue;
+
+            // sleep until the next frame is due, resyncing instead of fast-forwarding if we fell behind
+            auto now = clock::now();
+            deadline += frameTime;
+            if (deadline < now)
+                deadline = now;
+            else
+                std::this_thread::sleep_until(deadline);
         }
-        std::this_thread::sleep_for(std::chrono::microseconds(800));
+    });
+
+    // this thread only polls input and presents the newest screen at 60 Hz. updateDisplay() is
+    // cheap when nothing changed, and still repaints an exposed window
+    auto deadline = clock::now();
+    while (gui.handleInput(chip8, emulated.load(std::memory_order_relaxed))) {
+        frames.update();
+        gui.updateDisplay(frames.front());
+
+        deadline += frameTime;
+        auto now = clock::now();
+        if (deadline < now)
+            deadline = now;
+        else
+            std::this_thread::sleep_until(deadline);
     }
+
+    running.store(false, std::memory_order_relaxed);
+    emulation.join();
+    return 0;
 }
\ No newline at end of file
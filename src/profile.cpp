@@ -0,0 +1,71 @@
+#include "chip8.hpp"
+
+#include <iomanip>
+
+// reporting for CHIP8_PROFILE builds, the counting itself lives in chip8.cpp
+
+static_assert(Chip8::Profile::kClasses == 36, "one profile class per decoded handler");
+
+const char* Chip8::className(std::size_t cls) {
+    static const char* const names[Profile::kClasses] = {
+        nullptr,            "???? invalid",
+        "00E0 CLS",         "00EE RET",         "1nnn JP_addr",     "2nnn CALL",
+        "3xkk SE_Vx_byte",  "4xkk SNE_Vx_byte", "5xy0 SE_VxVy",
+        "6xkk LD_Vx_byte",  "7xkk ADD_Vx_byte",
+        "8xy0 LD_VxVy",     "8xy1 OR",          "8xy2 AND",         "8xy3 XOR",
+        "8xy4 ADD_VxVy",    "8xy5 SUB",         "8xy6 SHR",
+        "8xy7 SUBN",        "8xyE SHL",         "9xy0 SNE_VxVy",
+        "Annn LD_I_addr",   "Bnnn JP_addrV0",   "Cxkk RND",
+        "Dxyn DRW",         "Ex9E SKP",         "ExA1 SKNP",
+        "Fx07 LD_Vx_t",     "Fx0A LD_Vx_k",     "Fx15 LD_DT_Vx",    "Fx18 LD_ST_Vx",
+        "Fx1E ADD_I_Vx",    "Fx29 LD_F_Vx",     "Fx33 LD_BCD",
+        "Fx55 LD_wVF",      "Fx65 LD_rVF",
+    };
+    static_assert(op_count == Profile::kClasses, "class names out of sync with the handler ids");
+
+    return cls < Profile::kClasses ? names[cls] : nullptr;
+}
+
+// { "frames": n, "draws": n, "pixels": n, "instructions": n, "classes": { name: count },
+//   "pcs": { "0x2A4": count } }, zero counts left out
+void Chip8::writeProfileJson(std::ostream& out) const {
+    std::uint64_t total = 0;
+    for (std::uint64_t n : m_profile.classes)
+        total += n;
+
+    out << "{\n  \"frames\": " << m_profile.frames << ",\n  \"draws\": " << m_profile.draws
+        << ",\n  \"pixels\": " << m_profile.pixels << ",\n  \"instructions\": " << total << ",\n  \"classes\": {";
+
+    const char* sep = "\n";
+    for (std::size_t cls = 0; cls < Profile::kClasses; ++cls) {
+        if (m_profile.classes[cls] == 0)
+            continue;
+        out << sep << "    \"" << className(cls) << "\": " << m_profile.classes[cls];
+        sep = ",\n";
+    }
+
+    out << "\n  },\n  \"pcs\": {";
+    sep = "\n";
+    for (std::size_t pc = 0; pc < m_profile.pcHits.size(); ++pc) {
+        if (m_profile.pcHits[pc] == 0)
+            continue;
+        out << sep << "    \"0x" << std::hex << std::uppercase << std::setw(3) << std::setfill('0') << pc
+            << std::dec << std::nouppercase << std::setfill(' ') << "\": " << m_profile.pcHits[pc];
+        sep = ",\n";
+    }
+    out << "\n  }\n}\n";
+}
+
+// the class of each address is decoded from memory as it is now, so code that was
+// overwritten during the run is attributed to whatever replaced it
+void Chip8::writeProfileFolded(std::ostream& out) const {
+    for (std::size_t pc = 0; pc < m_profile.pcHits.size(); ++pc) {
+        if (m_profile.pcHits[pc] == 0)
+            continue;
+
+        std::uint16_t opcode = m_state.memory[pc] << 8 | m_state.memory[(pc + 1) & 0xFFF];
+        out << className(decodeHandler(opcode)) << ";0x" << std::hex << std::uppercase
+            << std::setw(3) << std::setfill('0') << pc << std::dec << std::nouppercase << std::setfill(' ')
+            << " " << m_profile.pcHits[pc] << "\n";
+    }
+}
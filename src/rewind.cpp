@@ -0,0 +1,143 @@
+#include "rewind.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(Chip8::State) < 0x10000, "delta run lengths are stored as 16-bit values");
+
+Rewind::Rewind(std::size_t capacity)
+    : m_ring(std::max(capacity, 4 * sizeof(Chip8::State))), m_scratch(2 * sizeof(Chip8::State) + 8), m_tail(0) {}
+
+void Rewind::clear() {
+    m_entries.clear();
+    m_tail = 0;
+}
+
+std::size_t Rewind::bytesUsed() const {
+    std::size_t used = 0;
+    for (const Entry& e : m_entries)
+        used += e.size;
+    return used;
+}
+
+void Rewind::push(const Chip8::State& state) {
+    const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(&state);
+
+    if (!m_entries.empty() && m_entries.back().sinceKey + 1 < kKeyframeInterval) {
+        std::size_t keyOffset = m_entries.back().keyOffset;
+        unsigned sinceKey = m_entries.back().sinceKey + 1;
+        std::size_t size = encode(bytes, &m_ring[keyOffset]);
+        std::size_t offset = allocate(size);
+
+        // making room can only take our keyframe with it once every older frame is gone,
+        // in which case this frame starts a new group below
+        if (!m_entries.empty()) {
+            std::memcpy(&m_ring[offset], m_scratch.data(), size);
+            m_entries.push_back({ offset, size, keyOffset, sinceKey });
+            return;
+        }
+    }
+
+    std::size_t offset = allocate(sizeof(Chip8::State));
+    std::memcpy(&m_ring[offset], bytes, sizeof(Chip8::State));
+    m_entries.push_back({ offset, sizeof(Chip8::State), offset, 0 });
+}
+
+bool Rewind::pop(Chip8::State& out) {
+    if (m_entries.empty())
+        return false;
+
+    const Entry& e = m_entries.back();
+    std::uint8_t* bytes = reinterpret_cast<std::uint8_t*>(&out);
+    if (e.sinceKey == 0)
+        std::memcpy(bytes, &m_ring[e.offset], sizeof(Chip8::State));
+    else
+        decode(&m_ring[e.offset], e.size, &m_ring[e.keyOffset], bytes);
+
+    m_entries.pop_back();
+    m_tail = m_entries.empty() ? 0 : m_entries.back().offset + m_entries.back().size;
+    return true;
+}
+
+// finds room for size contiguous bytes after the newest entry, dropping the oldest groups
+// (a keyframe and its deltas) until it fits
+std::size_t Rewind::allocate(std::size_t size) {
+    while (!m_entries.empty()) {
+        std::size_t head = m_entries.front().offset;
+
+        if (head < m_tail) {
+            // live data is [head, tail), free space at the end and in front of head
+            if (m_tail + size <= m_ring.size())
+                break;
+            if (size <= head) {
+                m_tail = 0;
+                break;
+            }
+        }
+        else if (head > m_tail && m_tail + size <= head) {
+            // wrapped around, free space is [tail, head)
+            break;
+        }
+
+        m_entries.pop_front();
+        while (!m_entries.empty() && m_entries.front().sinceKey != 0)
+            m_entries.pop_front();
+    }
+
+    if (m_entries.empty())
+        m_tail = 0;
+
+    std::size_t offset = m_tail;
+    m_tail += size;
+    return offset;
+}
+
+// XOR against the keyframe, stored as (u16 equal bytes, u16 literal bytes, literals...) tokens.
+// literals only end at a run of 4+ equal bytes so short gaps don't cost a token each
+std::size_t Rewind::encode(const std::uint8_t* state, const std::uint8_t* key) {
+    const std::size_t n = sizeof(Chip8::State);
+    std::uint8_t* out = m_scratch.data();
+    std::size_t i = 0;
+
+    while (i < n) {
+        std::size_t same = 0;
+        for (; i < n && state[i] == key[i]; ++i)
+            ++same;
+
+        std::size_t literalEnd = i;
+        for (std::size_t j = i, run = 0; j < n && run < 4; ++j) {
+            if (state[j] == key[j])
+                ++run;
+            else {
+                run = 0;
+                literalEnd = j + 1;
+            }
+        }
+
+        std::size_t literals = literalEnd - i;
+        *out++ = static_cast<std::uint8_t>(same);
+        *out++ = static_cast<std::uint8_t>(same >> 8);
+        *out++ = static_cast<std::uint8_t>(literals);
+        *out++ = static_cast<std::uint8_t>(literals >> 8);
+        for (; i < literalEnd; ++i)
+            *out++ = state[i] ^ key[i];
+    }
+
+    return static_cast<std::size_t>(out - m_scratch.data());
+}
+
+void Rewind::decode(const std::uint8_t* delta, std::size_t size, const std::uint8_t* key, std::uint8_t* out) {
+    const std::uint8_t* end = delta + size;
+    std::size_t pos = 0;
+
+    while (delta < end) {
+        std::size_t same     = delta[0] | delta[1] << 8;
+        std::size_t literals = delta[2] | delta[3] << 8;
+        delta += 4;
+
+        std::memcpy(out + pos, key + pos, same);
+        pos += same;
+        for (std::size_t i = 0; i < literals; ++i, ++pos)
+            out[pos] = key[pos] ^ *delta++;
+    }
+}
@@ -0,0 +1,197 @@
+#include "rom_library.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ROM_LIBRARY_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// pack layout: the magic, then per ROM a little-endian u16 name length, u32 size, the name and
+// the ROM bytes, up to the end of the file
+constexpr char kPackMagic[8] = { 'C', 'H', '8', 'P', 'A', 'C', 'K', '\0' };
+constexpr std::size_t kRecordHeader = 6;
+
+std::uint32_t readLE(const std::uint8_t* p, int bytes) {
+    std::uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+void writeLE(std::ofstream& out, std::uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i)
+        out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+}
+
+// one read-only file in memory for the lifetime of the library
+struct RomLibrary::Mapping {
+    const std::uint8_t* data = nullptr;
+    std::size_t size = 0;
+    std::vector<std::uint8_t> copy;         // the file contents where mmap isn't available
+    bool mapped = false;
+
+    ~Mapping() {
+#ifdef ROM_LIBRARY_MMAP
+        if (mapped)
+            munmap(const_cast<std::uint8_t*>(data), size);
+#endif
+    }
+
+    bool open(const std::string& path) {
+#ifdef ROM_LIBRARY_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+        size = ok ? static_cast<std::size_t>(st.st_size) : 0;
+        if (ok && size > 0) {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = p != MAP_FAILED;
+            if (ok) {
+                data = static_cast<const std::uint8_t*>(p);
+                mapped = true;
+            }
+        }
+        close(fd);
+        return ok;
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = copy.data();
+        size = copy.size();
+        return true;
+#endif
+    }
+};
+
+RomLibrary::RomLibrary() {}
+
+RomLibrary::~RomLibrary() {}
+
+std::uint64_t RomLibrary::hash(const std::uint8_t* data, std::size_t size) {
+    std::uint64_t hash = 0xCBF29CE484222325ULL;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+bool RomLibrary::add(const std::string& path) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error))
+        return addFile(path);
+
+    std::vector<std::string> files;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(path, error)) {
+        const auto extension = entry.path().extension();
+        if (entry.is_regular_file() && (extension == ".ch8" || extension == ".ch8pack"))
+            files.push_back(entry.path().string());
+    }
+    std::sort(files.begin(), files.end());
+
+    bool ok = !error;
+    for (const std::string& file : files)
+        ok &= addFile(file);
+    return ok;
+}
+
+bool RomLibrary::addFile(const std::string& path) {
+    auto mapping = std::make_unique<Mapping>();
+    if (!mapping->open(path))
+        return false;
+
+    const Mapping& file = *mapping;
+    m_mappings.push_back(std::move(mapping));
+
+    if (file.size >= sizeof(kPackMagic) && std::memcmp(file.data, kPackMagic, sizeof(kPackMagic)) == 0)
+        return addPack(file);
+
+    addRom(path, file.data, file.size);
+    return true;
+}
+
+// every record is checked against the mapping before anything is added
+bool RomLibrary::addPack(const Mapping& pack) {
+    std::vector<std::size_t> records;
+    for (std::size_t at = sizeof(kPackMagic); at < pack.size; ) {
+        if (pack.size - at < kRecordHeader)
+            return false;
+
+        std::size_t length = kRecordHeader + readLE(pack.data + at, 2) + readLE(pack.data + at + 2, 4);
+        if (pack.size - at < length)
+            return false;
+
+        records.push_back(at);
+        at += length;
+    }
+
+    for (std::size_t at : records) {
+        std::size_t nameLength = readLE(pack.data + at, 2);
+        const std::uint8_t* name = pack.data + at + kRecordHeader;
+        addRom(std::string(name, name + nameLength), name + nameLength, readLE(pack.data + at + 2, 4));
+    }
+    return true;
+}
+
+// identical bytes under another name share the first one's image
+void RomLibrary::addRom(const std::string& name, const std::uint8_t* data, std::size_t size) {
+    if (m_byName.count(name))
+        return;
+
+    Entry entry{ name, hash(data, size), data, size, nullptr };
+    auto same = m_byHash.find(entry.hash);
+    if (same != m_byHash.end() && m_entries[same->second].size == size &&
+        std::equal(data, data + size, m_entries[same->second].data))
+        entry.image = m_entries[same->second].image;
+    else if (size > 0)
+        entry.image = Chip8::loadImage(data, size);
+
+    if (entry.image && same == m_byHash.end())
+        m_byHash[entry.hash] = m_entries.size();
+    m_byName[name] = m_entries.size();
+    m_entries.push_back(std::move(entry));
+}
+
+const RomLibrary::Entry* RomLibrary::find(std::uint64_t hash) const {
+    auto it = m_byHash.find(hash);
+    return it == m_byHash.end() ? nullptr : &m_entries[it->second];
+}
+
+const RomLibrary::Entry* RomLibrary::find(const std::string& name) const {
+    auto it = m_byName.find(name);
+    return it == m_byName.end() ? nullptr : &m_entries[it->second];
+}
+
+bool RomLibrary::writePack(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    out.write(kPackMagic, sizeof(kPackMagic));
+
+    for (const Entry& entry : m_entries) {
+        if (entry.name.size() > 0xFFFF || entry.size > 0xFFFFFFFFu)
+            return false;
+
+        writeLE(out, static_cast<std::uint32_t>(entry.name.size()), 2);
+        writeLE(out, static_cast<std::uint32_t>(entry.size), 4);
+        out.write(entry.name.data(), static_cast<std::streamsize>(entry.name.size()));
+        out.write(reinterpret_cast<const char*>(entry.data), static_cast<std::streamsize>(entry.size));
+    }
+    return static_cast<bool>(out);
+}
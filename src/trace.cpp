@@ -0,0 +1,97 @@
+#include "trace.hpp"
+
+#include <algorithm>
+
+TraceWriter::TraceWriter(const std::string& path, std::size_t chunkSize, std::size_t chunks)
+    : m_file(path, std::ios::binary), m_ok(m_file.is_open()), m_chunkSize(std::max<std::size_t>(chunkSize, 64)),
+        m_ring(std::max<std::size_t>(chunks, 2), std::vector<std::uint8_t>(m_chunkSize)), m_sizes(m_ring.size(), 0),
+        m_head(0), m_tail(0), m_current(m_ring[0].data()), m_used(0), m_stop(false) {
+    const char header[8] = { 'C', '8', 'T', 'R', static_cast<char>(kVersion & 0xFF), static_cast<char>(kVersion >> 8), 0, 0 };
+    m_file.write(header, sizeof(header));
+    m_thread = std::thread(&TraceWriter::writerLoop, this);
+}
+
+TraceWriter::~TraceWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_ready.notify_one();
+    m_thread.join();
+}
+
+// passes the chunk being filled to the writer thread and moves on to the next one, only
+// waiting if that one hasn't been written out yet
+void TraceWriter::submit() {
+    if (m_used == 0)
+        return;
+
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_sizes[m_tail] = m_used;
+    m_tail = (m_tail + 1) % m_ring.size();
+    m_ready.notify_one();
+
+    m_written.wait(guard, [this] { return m_sizes[m_tail] == 0; });
+    m_current = m_ring[m_tail].data();
+    m_used = 0;
+}
+
+void TraceWriter::flush() {
+    submit();
+
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_written.wait(guard, [this] { return m_head == m_tail; });
+    m_file.flush();
+}
+
+void TraceWriter::writerLoop() {
+    std::unique_lock<std::mutex> guard(m_lock);
+
+    while (true) {
+        m_ready.wait(guard, [this] { return m_stop || m_sizes[m_head] != 0; });
+        if (m_sizes[m_head] == 0)
+            return;                         // stopping and nothing left to write
+
+        // the producer never touches a submitted chunk, so the write can happen unlocked
+        std::size_t chunk = m_head;
+        guard.unlock();
+        m_file.write(reinterpret_cast<const char*>(m_ring[chunk].data()), m_sizes[chunk]);
+        m_file.flush();
+        guard.lock();
+
+        m_ok = m_ok && m_file.good();
+        m_sizes[chunk] = 0;
+        m_head = (m_head + 1) % m_ring.size();
+        m_written.notify_all();
+    }
+}
+
+TraceReader::TraceReader(const std::string& path) : m_file(path, std::ios::binary), m_ok(false) {
+    char header[8];
+    if (m_file.read(header, sizeof(header)))
+        m_ok = header[0] == 'C' && header[1] == '8' && header[2] == 'T' && header[3] == 'R'
+            && (static_cast<std::uint8_t>(header[4]) | static_cast<std::uint8_t>(header[5]) << 8) == TraceWriter::kVersion;
+}
+
+bool TraceReader::next(TraceRecord& record) {
+    std::uint8_t fixed[8];
+    if (!m_ok || !m_file.read(reinterpret_cast<char*>(fixed), sizeof(fixed)))
+        return false;
+
+    record.pc      = fixed[0] | fixed[1] << 8;
+    record.opcode  = fixed[2] | fixed[3] << 8;
+    record.index   = fixed[4] | fixed[5] << 8;
+    record.changed = fixed[6] | fixed[7] << 8;
+    record.V.fill(0);
+
+    for (int i = 0; i < 16; ++i) {
+        if (record.changed & (1 << i)) {
+            char value;
+            if (!m_file.get(value))
+                return false;
+            record.V[i] = static_cast<std::uint8_t>(value);
+        }
+    }
+    return true;
+}
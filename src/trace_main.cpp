@@ -0,0 +1,109 @@
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "trace.hpp"
+
+// decodes and compares trace files written by a CHIP8_TRACE build (chip8_headless --trace)
+
+void handleError(const std::string& message) {
+    std::cerr << "[ERROR]\t(trace):\t " << message << "\n";
+    exit(-1);
+}
+
+void usage() {
+    std::cerr <<
+        "Usage: chip8_trace dump <trace> [first] [count]\n"
+        "       chip8_trace diff <trace-a> <trace-b> [context]\n";
+    exit(-1);
+}
+
+std::string format(std::uint64_t n, const TraceRecord& r) {
+    std::ostringstream out;
+    out << std::setw(10) << n << "  " << std::hex << std::uppercase << std::setfill('0')
+        << std::setw(3) << r.pc << "  " << std::setw(4) << r.opcode << "  I=" << std::setw(3) << r.index;
+
+    for (int i = 0; i < 16; ++i)
+        if (r.changed & (1 << i))
+            out << "  V" << i << "=" << std::setw(2) << static_cast<int>(r.V[i]);
+    return out.str();
+}
+
+bool sameRecord(const TraceRecord& a, const TraceRecord& b) {
+    if (a.pc != b.pc || a.opcode != b.opcode || a.index != b.index || a.changed != b.changed)
+        return false;
+
+    for (int i = 0; i < 16; ++i)
+        if ((a.changed & (1 << i)) && a.V[i] != b.V[i])
+            return false;
+    return true;
+}
+
+TraceReader open(const std::string& path) {
+    TraceReader reader(path);
+    if (!reader.ok())
+        handleError("Not a trace file: " + path);
+    return reader;
+}
+
+int dump(const std::string& path, std::uint64_t first, std::uint64_t count) {
+    TraceReader reader = open(path);
+    TraceRecord record;
+
+    for (std::uint64_t n = 0; reader.next(record); ++n) {
+        if (n < first)
+            continue;
+        if (n - first >= count)
+            break;
+        std::cout << format(n, record) << "\n";
+    }
+    return 0;
+}
+
+// prints the first record where the two traces disagree, with a few records of shared history
+int diff(const std::string& pathA, const std::string& pathB, std::size_t context) {
+    TraceReader a = open(pathA), b = open(pathB);
+    TraceRecord ra, rb;
+    std::deque<std::string> history;
+
+    for (std::uint64_t n = 0;; ++n) {
+        bool moreA = a.next(ra), moreB = b.next(rb);
+        if (!moreA && !moreB) {
+            std::cout << "traces are identical (" << n << " instructions)\n";
+            return 0;
+        }
+
+        if (moreA && moreB && sameRecord(ra, rb)) {
+            history.push_back(format(n, ra));
+            if (history.size() > context)
+                history.pop_front();
+            continue;
+        }
+
+        for (const std::string& line : history)
+            std::cout << "   " << line << "\n";
+        std::cout << "a: " << (moreA ? format(n, ra) : "<end of trace>") << "\n";
+        std::cout << "b: " << (moreB ? format(n, rb) : "<end of trace>") << "\n";
+        std::cout << "traces diverge at instruction " << n << "\n";
+        return 1;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3)
+        usage();
+
+    std::string command = argv[1];
+    if (command == "dump" && argc <= 5)
+        return dump(argv[2], argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 0,
+            argc > 4 ? std::strtoull(argv[4], nullptr, 10) : UINT64_MAX);
+
+    if (command == "diff" && argc >= 4 && argc <= 5)
+        return diff(argv[2], argv[3], argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 8);
+
+    usage();
+    return -1;
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <array>
+#include <emscripten.h>
+
+#include "chip8.hpp"
+#include "framebuffer.hpp"
+#include "rewind.hpp"
+
+// the emulator core for a Web Worker or Node, without SDL: a flat C API over one Chip8 that
+// client/worker.js drives from its own animation frames and draws to an OffscreenCanvas with.
+// key events reach the worker through a SharedArrayBuffer ring (client/key_ring.js) and come in
+// here through chip8_key(), so the page's main thread never runs emulation
+
+namespace {
+
+constexpr double kFrameMs = 1000.0 / Chip8::kTimerHz;
+constexpr int kMaxFramesPerTick = 4;    // after a longer stall the backlog is dropped, not raced through
+
+// canvas ImageData wants R, G, B, A bytes, so the palette is given as little-endian ABGR
+constexpr std::uint32_t toABGR(std::uint32_t argb) {
+    return (argb & 0xFF00FF00u) | ((argb >> 16) & 0xFFu) | ((argb & 0xFFu) << 16);
+}
+
+constexpr Framebuffer::Palette kCanvasPalette = {
+    toABGR(Framebuffer::kDefaultPalette.foreground), toABGR(Framebuffer::kDefaultPalette.background)
+};
+
+Chip8 chip8;
+Rewind history(1024 * 1024);
+Chip8::State previous;
+std::array<std::uint32_t, 64 * 32> pixels;
+std::array<std::uint64_t, 16> pressedAt;
+double lastTick = -1.0;
+double behind = 0.0;
+
+// expands the screen into pixels if anything changed since the last call
+bool present() {
+    if (!chip8.dirtyRows())
+        return false;
+
+    Framebuffer::expandRows(chip8.state().display.data(), 32, pixels.data(), 64, kCanvasPalette);
+    chip8.clearDirtyRows();
+    chip8.drawFlag = false;
+    return true;
+}
+
+}
+
+extern "C" {
+    // false if the file is missing or doesn't fit. rewind history and frame pacing start over
+    EMSCRIPTEN_KEEPALIVE int chip8_load(const char* path, double seed) {
+        history.clear();
+        pressedAt.fill(0);
+        lastTick = -1.0;
+        behind = 0.0;
+        pixels.fill(kCanvasPalette.background);
+        chip8.enableInputQueue();
+        return chip8.loadROM(path, static_cast<std::uint64_t>(seed));
+    }
+
+    // instructions per second, at least 60 (one per frame)
+    EMSCRIPTEN_KEEPALIVE void chip8_set_speed(int ips) {
+        if (ips >= static_cast<int>(Chip8::kTimerHz))
+            chip8.setClockSpeed(static_cast<unsigned>(ips));
+    }
+
+    // a release is held back until the press had a whole frame, as Gui::queueKey() does
+    EMSCRIPTEN_KEEPALIVE void chip8_key(int key, int pressed) {
+        std::uint64_t cycle = chip8.state().cycles;
+        key &= 0xF;
+        if (pressed)
+            pressedAt[key] = cycle;
+        else
+            cycle = std::max<std::uint64_t>(cycle, pressedAt[key] + chip8.cyclesPerFrame());
+
+        chip8.queueKey({ cycle, static_cast<std::uint8_t>(key), pressed != 0 });
+    }
+
+    // runs whole 60 Hz frames (or steps them back while rewinding), returns 1 if chip8_pixels()
+    // changed
+    EMSCRIPTEN_KEEPALIVE int chip8_run_frames(int frames, int rewinding) {
+        for (int i = 0; i < frames; ++i) {
+            if (rewinding) {
+                chip8.flushInput();
+                if (history.pop(previous)) {
+                    previous.key = chip8.state().key;
+                    chip8.loadState(previous);
+                }
+            }
+            else {
+                chip8.runUntilFrame();
+                history.push(chip8.state());
+            }
+        }
+        return present();
+    }
+
+    // runs the frames that came due on the wall clock (ms, e.g. an animation frame timestamp)
+    // since the last call
+    EMSCRIPTEN_KEEPALIVE int chip8_tick(double now, int rewinding) {
+        if (lastTick < 0.0)
+            lastTick = now;
+        behind += now - lastTick;
+        lastTick = now;
+
+        int frames = static_cast<int>(behind / kFrameMs);
+        if (frames > kMaxFramesPerTick) {
+            frames = kMaxFramesPerTick;
+            behind = 0.0;
+        }
+        else {
+            behind -= frames * kFrameMs;
+        }
+        return chip8_run_frames(frames, rewinding);
+    }
+
+    // 64 x 32 RGBA pixels, valid until the next call that runs frames
+    EMSCRIPTEN_KEEPALIVE const std::uint32_t* chip8_pixels() {
+        return pixels.data();
+    }
+
+    EMSCRIPTEN_KEEPALIVE double chip8_cycles() {
+        return static_cast<double>(chip8.state().cycles);
+    }
+
+    // Chip8::frameHash() as 16 hex digits, the same as chip8_headless --hash prints
+    EMSCRIPTEN_KEEPALIVE const char* chip8_frame_hash() {
+        static char hex[17];
+        std::uint64_t hash = chip8.frameHash();
+        for (int i = 15; i >= 0; --i, hash >>= 4)
+            hex[i] = "0123456789abcdef"[hash & 0xF];
+        return hex;
+    }
+}
@@ -1,6 +1,21 @@
+#include "batch.hpp"
 #include "chip8.hpp"
+#include "framebuffer.hpp"
+#include "jit.hpp"
+#include "lockstep.hpp"
+#include "rewind.hpp"
+#include "rom_library.hpp"
+#include "trace.hpp"
+#include "triple_buffer.hpp"
 #include <gtest/gtest.h>
 
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <thread>
+
 class Chip8Tests : public ::testing::Test {
 protected:
     Chip8 chip8;
@@ -8,6 +23,22 @@ protected:
     void SetUp() override {
         chip8.reset(); 
     }
+
+    // writes big-endian opcodes into memory starting at 0x200
+    void loadProgram(std::initializer_list<std::uint16_t> opcodes) {
+        std::uint16_t address = 0x200;
+        for (std::uint16_t opcode : opcodes) {
+            chip8.m_state.memory[address++] = opcode >> 8;
+            chip8.m_state.memory[address++] = opcode & 0xFF;
+        }
+        chip8.m_state.pc = 0x200;
+    }
+
+    // raw bytes of the whole machine state, for comparing two machines
+    static std::vector<std::uint8_t> machineState(const Chip8& c) {
+        const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(&c.m_state);
+        return std::vector<std::uint8_t>(bytes, bytes + sizeof(Chip8::State));
+    }
 };
 
 class GTestOut : public std::stringstream {
@@ -22,153 +53,153 @@ public:
 
 // CLS - clear screen (opcode 0x00E0)
 TEST_F(Chip8Tests, Test_CLS) {
-    for (int i = 0; i < 2048; ++i)          // draw on all pixels
-        chip8.display[i] = 1;
+    for (auto& row : chip8.m_state.display)     // draw on all pixels
+        row = ~0ULL;
     EXPECT_EQ(chip8.drawFlag, false); 
-    int pcBefore = chip8.m_pc;
+    int pcBefore = chip8.m_state.pc;
 
     GTCOUT << "set all pixels to 1, i.e., drew to all pixels on screen";
     chip8.CLS();
     GTCOUT << "CLS should clear screen so no pixels are visible on it";
 
-    for (const auto& pixel : chip8.display) // all pixels should now be set to 0
-        EXPECT_EQ(pixel, 0);
+    for (const auto& row : chip8.m_state.display) // all pixels should now be set to 0
+        EXPECT_EQ(row, 0ULL);
     EXPECT_EQ(chip8.drawFlag, true); 
-    EXPECT_EQ(chip8.m_pc, pcBefore + 2);
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 2);
 }
 
 // RET - return from subroutine (opcode 0x00EE)
 TEST_F(Chip8Tests, Test_RET) {
-    chip8.m_sp = 0x003;
-    chip8.m_stack[chip8.m_sp] = 0x001;
-    chip8.m_pc = 0x221;
+    chip8.m_state.sp = 0x003;
+    chip8.m_state.stack[chip8.m_state.sp] = 0x001;
+    chip8.m_state.pc = 0x221;
 
-    int pcBefore = chip8.m_pc;
+    int pcBefore = chip8.m_state.pc;
 
-    GTCOUT << "stack at original index (SP-1) should point to current PC: " << chip8.m_pc;
-    GTCOUT << "stack pointer (SP) should decrement by 1, from " << chip8.m_sp << " to " << chip8.m_sp - 1;
+    GTCOUT << "stack at original index (SP-1) should point to current PC: " << chip8.m_state.pc;
+    GTCOUT << "stack pointer (SP) should decrement by 1, from " << chip8.m_state.sp << " to " << chip8.m_state.sp - 1;
     GTCOUT << "PC should jump to the address stored in the stack";
 
     chip8.RET();
 
-    EXPECT_EQ(chip8.m_sp, 0x002); // SP should have decremented by 1
-    EXPECT_EQ(chip8.m_pc - 2, chip8.m_stack[chip8.m_sp]); // stack should point to prev. PC
+    EXPECT_EQ(chip8.m_state.sp, 0x002); // SP should have decremented by 1
+    EXPECT_EQ(chip8.m_state.pc - 2, chip8.m_state.stack[chip8.m_state.sp]); // stack should point to prev. PC
 }
 
 // JP_addr - jump to address (opcode 0x1nnn)
 TEST_F(Chip8Tests, Test_JP_addr) {
-    chip8.m_pc = 0x023;
-    GTCOUT << "the PC is currently equal to: " << chip8.m_pc;
+    chip8.m_state.pc = 0x023;
+    GTCOUT << "the PC is currently equal to: " << chip8.m_state.pc;
 
     chip8.addr = 0x201;
     GTCOUT << "the current address is: " << chip8.addr;
     GTCOUT << "so, the PC should jump to a value of: " << chip8.addr;
 
     chip8.JP_addr();
-    EXPECT_EQ(chip8.m_pc, chip8.addr);
+    EXPECT_EQ(chip8.m_state.pc, chip8.addr);
 }
 
 // CALL - call subroutine (opcode 0x2nnn)
 TEST_F(Chip8Tests, Test_CALL) {
-    chip8.m_sp = 0x003;
-    chip8.m_stack[chip8.m_sp] = 0x001;
-    chip8.m_pc = 0x221;
+    chip8.m_state.sp = 0x003;
+    chip8.m_state.stack[chip8.m_state.sp] = 0x001;
+    chip8.m_state.pc = 0x221;
     chip8.addr = 0x321;
 
-    int pcBefore = chip8.m_pc;
+    int pcBefore = chip8.m_state.pc;
     
 
-    GTCOUT << "stack at original index (SP-1) should point to current PC: " << chip8.m_pc;
-    GTCOUT << "stack pointer (SP) should increment by 1, from " << chip8.m_sp << " to " << chip8.m_sp + 1;
+    GTCOUT << "stack at original index (SP-1) should point to current PC: " << chip8.m_state.pc;
+    GTCOUT << "stack pointer (SP) should increment by 1, from " << chip8.m_state.sp << " to " << chip8.m_state.sp + 1;
     GTCOUT << "PC should jump to address: " << chip8.addr;
 
     chip8.CALL();
 
-    EXPECT_EQ(chip8.m_sp, 0x004); // should have incremented by 1
-    EXPECT_EQ(chip8.m_stack[chip8.m_sp - 1], pcBefore); // should point to prev. PC
-    EXPECT_EQ(chip8.m_pc, chip8.addr); // PC val should have jumped to addr
+    EXPECT_EQ(chip8.m_state.sp, 0x004); // should have incremented by 1
+    EXPECT_EQ(chip8.m_state.stack[chip8.m_state.sp - 1], pcBefore); // should point to prev. PC
+    EXPECT_EQ(chip8.m_state.pc, chip8.addr); // PC val should have jumped to addr
 }
 
 // SE_Vx_byte - skip next instruction if Vx equals byte (opcode 0x3xkk)
 TEST_F(Chip8Tests, Test_SE_Vx_byte) {
-    chip8.m_V[0] = 0x0A;
+    chip8.m_state.V[0] = 0x0A;
     chip8.byte = 0x0A;
-    chip8.m_pc = 0x201;
+    chip8.m_state.pc = 0x201;
 
-    int pcBefore = chip8.m_pc;
+    int pcBefore = chip8.m_state.pc;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
     GTCOUT << "byte is currently equal to: " << chip8.byte;
-    GTCOUT << "PC is currently equal to: " << chip8.m_pc;
+    GTCOUT << "PC is currently equal to: " << chip8.m_state.pc;
 
     GTCOUT << "since V0 is equal to byte, the next instruction should be skipped";
     chip8.SE_Vx_byte();
 
-    EXPECT_EQ(chip8.m_pc, pcBefore + 4);
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 4);
 }
 
 // SNE_Vx_byte - skip next instruction if Vx does not equal byte (opcode 0x4xkk)
 TEST_F(Chip8Tests, Test_SNE_Vx_byte) {
-    chip8.m_V[0] = 0x0A;
+    chip8.m_state.V[0] = 0x0A;
     chip8.byte = 0x0B;
-    chip8.m_pc = 0x201;
+    chip8.m_state.pc = 0x201;
 
-    int pcBefore = chip8.m_pc;
+    int pcBefore = chip8.m_state.pc;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
     GTCOUT << "byte is currently equal to: " << chip8.byte;
-    GTCOUT << "PC is currently equal to: " << chip8.m_pc;
+    GTCOUT << "PC is currently equal to: " << chip8.m_state.pc;
 
     GTCOUT << "since V0 is not equal to byte, the next instruction should not be skipped";
     chip8.SNE_Vx_byte();
 
-    EXPECT_EQ(chip8.m_pc, pcBefore + 4);
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 4);
 }
 
 // SE_VxVy - skip next instruction if Vx equals Vy (opcode 0x5xy0)
 TEST_F(Chip8Tests, Test_SE_VxVy) {
-    chip8.m_V[0] = 0x0A;
-    chip8.m_V[1] = 0x0A;
-    chip8.m_pc = 0x201;
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.V[1] = 0x0A;
+    chip8.m_state.pc = 0x201;
 
-    int pcBefore = chip8.m_pc;
+    int pcBefore = chip8.m_state.pc;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[1]);
-    GTCOUT << "PC is currently equal to: " << chip8.m_pc;
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[1]);
+    GTCOUT << "PC is currently equal to: " << chip8.m_state.pc;
 
     GTCOUT << "since V0 is equal to V1, the next instruction should be skipped";
     chip8.SE_VxVy();
 
-    EXPECT_EQ(chip8.m_pc, pcBefore + 4);
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 4);
 }
 
 // LD_Vx_byte - set Vx to byte (opcode 0x6xkk)
 TEST_F(Chip8Tests, Test_LD_Vx_byte) {
-    chip8.m_V[0] = 0x0A;
+    chip8.m_state.V[0] = 0x0A;
     chip8.byte = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
     GTCOUT << "byte is currently equal to: " << chip8.byte;
 
     GTCOUT << "V0 should be set to byte";
     chip8.LD_Vx_byte();
 
-    EXPECT_EQ(chip8.m_V[0], chip8.byte);
+    EXPECT_EQ(chip8.m_state.V[0], chip8.byte);
 }
 
 // ADD_Vx_byte - add byte to Vx (opcode 0x7xkk)
 TEST_F(Chip8Tests, Test_ADD_Vx_byte) {
-    chip8.m_V[0] = 0x0A;
+    chip8.m_state.V[0] = 0x0A;
     chip8.byte = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
     GTCOUT << "byte is currently equal to: " << chip8.byte;
 
     GTCOUT << "V0 should be incremented by byte";
     chip8.ADD_Vx_byte();
 
-    EXPECT_EQ(chip8.m_V[0], 0x15);
+    EXPECT_EQ(chip8.m_state.V[0], 0x15);
 }
 
 // LD_VxVy - set Vx to Vy (opcode 0x8xy0)
@@ -176,362 +207,1437 @@ TEST_F(Chip8Tests, Test_LD_VxVy) {
     chip8.x = 0x0;
     chip8.y = 0x1;
 
-    chip8.m_V[chip8.x] = 0x0A;
-    chip8.m_V[chip8.y] = 0x0B;
+    chip8.m_state.V[chip8.x] = 0x0A;
+    chip8.m_state.V[chip8.y] = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[chip8.x]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[chip8.y]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[chip8.x]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[chip8.y]);
 
     GTCOUT << "V0 should be set to V1";
     chip8.LD_VxVy();
 
-    EXPECT_EQ(chip8.m_V[chip8.x], chip8.m_V[chip8.y]);
+    EXPECT_EQ(chip8.m_state.V[chip8.x], chip8.m_state.V[chip8.y]);
 }
 
 // OR - bitwise OR Vx with Vy (opcode 0x8xy1)
 TEST_F(Chip8Tests, Test_OR) {
-    chip8.m_V[0] = 0x0A;
-    chip8.m_V[1] = 0x0B;
+    chip8.x = 0x0;
+    chip8.y = 0x1;
+
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.V[1] = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[1]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[1]);
 
     GTCOUT << "V0 should be set to the result of V0 | V1";
     chip8.OR();
 
-    EXPECT_EQ(chip8.m_V[0], 0x0B);   
+    EXPECT_EQ(chip8.m_state.V[0], 0x0B);   
 }
 
 // AND - bitwise AND Vx with Vy (opcode 0x8xy2)
 TEST_F(Chip8Tests, Test_AND) {
-    chip8.m_V[0] = 0x0A;
-    chip8.m_V[1] = 0x0B;
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.V[1] = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[1]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[1]);
 
     GTCOUT << "V0 should be set to the result of V0 & V1";
     chip8.AND();
 
-    EXPECT_EQ(chip8.m_V[0], 0x0A);   
+    EXPECT_EQ(chip8.m_state.V[0], 0x0A);   
 }
 
 // XOR - bitwise XOR Vx with Vy (opcode 0x8xy3)
 TEST_F(Chip8Tests, Test_XOR) {
-    chip8.m_V[0] = 0x0A;
-    chip8.m_V[1] = 0x0B;
+    chip8.x = 0x0;
+    chip8.y = 0x1;
+
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.V[1] = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[1]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[1]);
 
     GTCOUT << "V0 should be set to the result of V0 ^ V1";
     chip8.XOR();
 
-    EXPECT_EQ(chip8.m_V[0], 0x01);   
+    EXPECT_EQ(chip8.m_state.V[0], 0x01);   
 }
 
 // ADD_VxVy - add Vy to Vx (opcode 0x8xy4)
 TEST_F(Chip8Tests, Test_ADD_VxVy) {
-    chip8.m_V[0] = 0x0A;
-    chip8.m_V[1] = 0x0B;
+    chip8.x = 0x0;
+    chip8.y = 0x1;
+
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.V[1] = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[1]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[1]);
 
     GTCOUT << "V0 should be incremented by V1";
     chip8.ADD_VxVy();
 
-    EXPECT_EQ(chip8.m_V[0], 0x15);
-    EXPECT_EQ(chip8.m_V[0xF], 0x00); // VF should be 0
+    EXPECT_EQ(chip8.m_state.V[0], 0x15);
+    EXPECT_EQ(chip8.m_state.V[0xF], 0x00); // VF should be 0
 }
 
 // SUB - subtract Vy from Vx (opcode 0x8xy5)
 TEST_F(Chip8Tests, Test_SUB) {
-    chip8.m_V[0] = 0x0B;
-    chip8.m_V[1] = 0x0A;
+    chip8.x = 0x0;
+    chip8.y = 0x1;
+
+    chip8.m_state.V[0] = 0x0B;
+    chip8.m_state.V[1] = 0x0A;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[1]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[1]);
 
     GTCOUT << "V0 should be decremented by V1";
     chip8.SUB();
 
-    EXPECT_EQ(chip8.m_V[0], 0x01);
-    EXPECT_EQ(chip8.m_V[0xF], 0); // VF should be 0 (false) as V1 > V0 now
+    EXPECT_EQ(chip8.m_state.V[0], 0x01);
+    EXPECT_EQ(chip8.m_state.V[0xF], 0); // VF should be 0 (false) as V1 > V0 now
 }
 
 // SHR - shift Vx right by 1 (opcode 0x8xy6)
 TEST_F(Chip8Tests, Test_SHR) {
-    chip8.m_V[0] = 0x0B;
+    chip8.m_state.V[0] = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
 
     GTCOUT << "V0 should be shifted right by 1";
     chip8.SHR();
 
-    EXPECT_EQ(chip8.m_V[0], 0x05);
-    EXPECT_EQ(chip8.m_V[0xF], 0x01); // VF should be 1
+    EXPECT_EQ(chip8.m_state.V[0], 0x05);
+    EXPECT_EQ(chip8.m_state.V[0xF], 0x01); // VF should be 1
 }
 
 // SUBN - subtract Vx from Vy (opcode 0x8xy7)
 TEST_F(Chip8Tests, Test_SUBN) {
-    chip8.m_V[0] = 0x0A;
-    chip8.m_V[1] = 0x0B;
+    chip8.x = 0x0;
+    chip8.y = 0x1;
+
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.V[1] = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[1]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[1]);
 
     GTCOUT << "V0 should be decremented by V1";
     chip8.SUBN();
 
-    EXPECT_EQ(chip8.m_V[0], 0x01);
-    EXPECT_EQ(chip8.m_V[0xF], 0x01); // VF should be 1
+    EXPECT_EQ(chip8.m_state.V[0], 0x01);
+    EXPECT_EQ(chip8.m_state.V[0xF], 0x01); // VF should be 1
 }
 
 // SHL - shift Vx left by 1 (opcode 0x8xyE)
 TEST_F(Chip8Tests, Test_SHL) {
-    chip8.m_V[0] = 0x0B;
+    chip8.m_state.V[0] = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
 
     GTCOUT << "V0 should be shifted left by 1";
     chip8.SHL();
 
-    EXPECT_EQ(chip8.m_V[0], 0x16);
-    EXPECT_EQ(chip8.m_V[0xF], 0x00); // VF should be 0
+    EXPECT_EQ(chip8.m_state.V[0], 0x16);
+    EXPECT_EQ(chip8.m_state.V[0xF], 0x00); // VF should be 0
 }
 
 // SNE_VxVy - skip next instruction if Vx does not equal Vy (opcode 0x9xy0)
 TEST_F(Chip8Tests, Test_SNE_VxVy) {
-    chip8.m_V[0] = 0x0A;
-    chip8.m_V[1] = 0x0B;
-    chip8.m_pc = 0x201;
+    chip8.x = 0x0;
+    chip8.y = 0x1;
+
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.V[1] = 0x0B;
+    chip8.m_state.pc = 0x201;
 
-    int pcBefore = chip8.m_pc;
+    int pcBefore = chip8.m_state.pc;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[1]);
-    GTCOUT << "PC is currently equal to: " << chip8.m_pc;
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[1]);
+    GTCOUT << "PC is currently equal to: " << chip8.m_state.pc;
 
     GTCOUT << "since V0 is not equal to V1, the next instruction should be skipped";
     chip8.SNE_VxVy();
 
-    EXPECT_EQ(chip8.m_pc, pcBefore + 4);
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 4);
 }
 
 // LD_I_addr - set index (I) to address (opcode 0xAnnn)
 TEST_F(Chip8Tests, Test_LD_I_addr) {
-    chip8.m_index = 0x0A;
+    chip8.m_state.index = 0x0A;
     chip8.addr = 0x0B;
 
-    GTCOUT << "I is currently equal to: " << chip8.m_index;
+    GTCOUT << "I is currently equal to: " << chip8.m_state.index;
     GTCOUT << "address is currently equal to: " << chip8.addr;
 
     GTCOUT << "I should be set to address";
     chip8.LD_I_addr();
 
-    EXPECT_EQ(chip8.m_index, chip8.addr);
+    EXPECT_EQ(chip8.m_state.index, chip8.addr);
 }
 
 // JP_addrV0 - jump to address + V0 (opcode 0xBnnn)
 TEST_F(Chip8Tests, Test_JP_addrV0) {
-    chip8.m_V[0] = 0x0A;
+    chip8.m_state.V[0] = 0x0A;
     chip8.addr = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
     GTCOUT << "address is currently equal to: " << chip8.addr;
 
     GTCOUT << "PC should be set to address + V0";
     chip8.JP_addrV0();
 
-    EXPECT_EQ(chip8.m_pc, 0x15);
+    EXPECT_EQ(chip8.m_state.pc, 0x15);
 }
 
 // RND - set Vx to random byte AND kk (opcode 0xCxkk)
 TEST_F(Chip8Tests, Test_RND) {
-    chip8.m_V[0] = 0x0A;
+    chip8.m_state.V[0] = 0x0A;
     chip8.byte = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
     GTCOUT << "byte is currently equal to: " << chip8.byte;
 
     GTCOUT << "V0 should be set to a random byte AND byte";
     chip8.RND();
 
-    EXPECT_EQ(chip8.m_V[0] & chip8.byte, chip8.m_V[0]);
+    EXPECT_EQ(chip8.m_state.V[0] & chip8.byte, chip8.m_state.V[0]);
+}
+
+// RND - the sequence should only depend on the seed given to reset()
+TEST_F(Chip8Tests, Test_RND_Seed) {
+    Chip8 same, other;
+    chip8.reset(42);
+    same.reset(42);
+    other.reset(43);
+
+    std::vector<std::uint8_t> a, b, c;
+    for (int i = 0; i < 64; ++i) {
+        a.push_back(chip8.randomByte());
+        b.push_back(same.randomByte());
+        c.push_back(other.randomByte());
+    }
+
+    GTCOUT << "the same seed should replay the same bytes, a different one should not";
+    EXPECT_EQ(a, b);
+    EXPECT_NE(a, c);
+    EXPECT_NE(std::count(a.begin(), a.end(), a[0]), 64);
+
+    chip8.reset(42);
+    EXPECT_EQ(chip8.randomByte(), a[0]);
 }
 
 // DRW - draw sprite at Vx, Vy (opcode 0xDxyn)
 TEST_F(Chip8Tests, Test_DRW) {
-    chip8.m_V[0] = 0x0A;
-    chip8.m_V[1] = 0x0B;
-    chip8.m_index = 0x0;
-    chip8.m_memory[0] = 0xF0;
-    chip8.m_memory[1] = 0x90;
-    chip8.m_memory[2] = 0x90;
-    chip8.m_memory[3] = 0x90;
-    chip8.m_memory[4] = 0xF0;
-
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_V[1]);
-    GTCOUT << "I is currently equal to: " << chip8.m_index;
+    chip8.x = 0x0;
+    chip8.y = 0x1;
+    chip8.mask = 0x5;
+
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.V[1] = 0x0B;
+    chip8.m_state.index = 0x0;
+    chip8.m_state.memory[0] = 0xF0;
+    chip8.m_state.memory[1] = 0x90;
+    chip8.m_state.memory[2] = 0x90;
+    chip8.m_state.memory[3] = 0x90;
+    chip8.m_state.memory[4] = 0xF0;
+
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "V1 is currently equal to: " << static_cast<int>(chip8.m_state.V[1]);
+    GTCOUT << "I is currently equal to: " << chip8.m_state.index;
 
     GTCOUT << "a sprite should be drawn at V0, V1";
     chip8.DRW();
 
     for (int i = 0; i < 5; ++i) {
-        EXPECT_EQ(chip8.display[i], 0x00);
+        EXPECT_EQ(chip8.m_state.display[i], 0x00);
     }
+    EXPECT_EQ(chip8.m_state.display[0x0B], 0xF0ULL << (56 - 0x0A));
+    EXPECT_EQ(chip8.m_state.display[0x0C], 0x90ULL << (56 - 0x0A));
+    EXPECT_TRUE(chip8.pixel(0x0A, 0x0B));
+    EXPECT_FALSE(chip8.pixel(0x0B, 0x0C));
+    EXPECT_EQ(chip8.m_state.V[0xF], 0x00);
+
+    GTCOUT << "drawing the same sprite again should erase it and set VF";
+    chip8.DRW();
+
+    for (const auto& row : chip8.m_state.display)
+        EXPECT_EQ(row, 0ULL);
+    EXPECT_EQ(chip8.m_state.V[0xF], 0x01);
+}
+
+// DRW - sprites are clipped at the right and bottom edges of the screen
+TEST_F(Chip8Tests, Test_DRW_Clip) {
+    chip8.x = 0x0;
+    chip8.y = 0x1;
+    chip8.mask = 0x3;
+
+    chip8.m_state.V[0] = 60;
+    chip8.m_state.V[1] = 30;
+    chip8.m_state.index = 0x0;
+    chip8.m_state.memory[0] = 0xFF;
+    chip8.m_state.memory[1] = 0xFF;
+    chip8.m_state.memory[2] = 0xFF;
+
+    GTCOUT << "an 8x3 sprite drawn at (60, 30) should only cover the 4x2 corner";
+    chip8.DRW();
+
+    EXPECT_EQ(chip8.m_state.display[30], 0xFULL);
+    EXPECT_EQ(chip8.m_state.display[31], 0xFULL);
+    EXPECT_EQ(chip8.m_state.display[0], 0ULL);
+    EXPECT_EQ(chip8.m_state.V[0xF], 0x00);
+}
+
+// DRW - only rows that had sprite pixels XORed onto them are reported as dirty
+TEST_F(Chip8Tests, Test_DirtyRows) {
+    EXPECT_EQ(chip8.dirtyRows(), ~0u);          // reset cleared the whole screen
+    chip8.clearDirtyRows();
+
+    chip8.x = 0x0;
+    chip8.y = 0x1;
+    chip8.mask = 0x4;
+    chip8.m_state.V[0] = 8;
+    chip8.m_state.V[1] = 10;
+    chip8.m_state.index = 0x300;
+    chip8.m_state.memory[0x300] = 0x81;
+    chip8.m_state.memory[0x301] = 0x00;         // blank sprite row, nothing changes on row 11
+    chip8.m_state.memory[0x302] = 0x18;
+    chip8.m_state.memory[0x303] = 0xFF;
+
+    chip8.DRW();
+    EXPECT_EQ(chip8.dirtyRows(), (1u << 10) | (1u << 12) | (1u << 13));
+
+    GTCOUT << "restoring a snapshot marks just the rows that differ";
+    Chip8::State before;
+    chip8.saveState(before);
+    chip8.m_state.memory[0x303] = 0x00;
+    chip8.DRW();                                // rows 10 and 12 back to blank, row 13 keeps its pixels
+    chip8.clearDirtyRows();
+    chip8.loadState(before);
+    EXPECT_EQ(chip8.dirtyRows(), (1u << 10) | (1u << 12));
+
+    chip8.clearDirtyRows();
+    chip8.CLS();
+    EXPECT_EQ(chip8.dirtyRows(), ~0u);
 }
 
 // SKP - skip next instruction if key with value of Vx is pressed (opcode 0xEx9E)
 TEST_F(Chip8Tests, Test_SKP) {
-    chip8.m_V[0] = 0x0A;
-    chip8.key[0x0A] = 1;
-    chip8.m_pc = 0x201;
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.key[0x0A] = 1;
+    chip8.m_state.pc = 0x201;
 
-    int pcBefore = chip8.m_pc;
+    int pcBefore = chip8.m_state.pc;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
     GTCOUT << "key with value of V0 is currently pressed";
 
     GTCOUT << "since key with value of V0 is pressed, the next instruction should be skipped";
     chip8.SKP();
 
-    EXPECT_EQ(chip8.m_pc, pcBefore + 4);
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 4);
+
+    GTCOUT << "keys above F wrap around the keypad instead of reading past it: 0x1F checks key F";
+    chip8.m_state.V[0] = 0x1F;
+    chip8.m_state.key[0x0F] = 1;
+    chip8.SKP();
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 8);
+
+    chip8.m_state.key[0x0F] = 0;
+    chip8.SKP();
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 10);
 }
 
 // SKNP - skip next instruction if key with value of Vx is not pressed (opcode 0xExA1)
 TEST_F(Chip8Tests, Test_SKNP) {
-    chip8.m_V[0] = 0x0A;
-    chip8.key[0x0A] = 0;
-    chip8.m_pc = 0x201;
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.key[0x0A] = 0;
+    chip8.m_state.pc = 0x201;
 
-    int pcBefore = chip8.m_pc;
+    int pcBefore = chip8.m_state.pc;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
     GTCOUT << "key with value of V0 is currently not pressed";
 
     GTCOUT << "since key with value of V0 is not pressed, the next instruction should not be skipped";
     chip8.SKNP();
 
-    EXPECT_EQ(chip8.m_pc, pcBefore + 4);
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 4);
+
+    GTCOUT << "keys above F wrap around the keypad instead of reading past it: 0x1F checks key F";
+    chip8.m_state.V[0] = 0x1F;
+    chip8.m_state.key[0x0F] = 1;
+    chip8.SKNP();
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 6);
+
+    chip8.m_state.key[0x0F] = 0;
+    chip8.SKNP();
+    EXPECT_EQ(chip8.m_state.pc, pcBefore + 10);
 }
 
 // LD_Vx_t - set Vx to delay timer (opcode 0xFx07)
 TEST_F(Chip8Tests, Test_LD_Vx_t) {
-    chip8.m_V[0] = 0x0A;
-    chip8.m_delayTimer = 0x0B;
+    chip8.m_state.V[0] = 0x0A;
+    chip8.m_state.delayTimer = 0x0B;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "delay timer is currently equal to: " << chip8.m_delayTimer;
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "delay timer is currently equal to: " << chip8.m_state.delayTimer;
 
     GTCOUT << "V0 should be set to delay timer";
     chip8.LD_Vx_t();
 
-    EXPECT_EQ(chip8.m_V[0], chip8.m_delayTimer);
+    EXPECT_EQ(chip8.m_state.V[0], chip8.m_state.delayTimer);
 }
 
 // LD_Vx_k - wait for key press and store value in Vx (opcode 0xFx0A)
 TEST_F(Chip8Tests, Test_LD_Vx_k) {
     int keyPressed = 0x0A;
-    chip8.key[keyPressed] = 1;
+    chip8.m_state.key[keyPressed] = 1;
     chip8.x = keyPressed;
 
     GTCOUT << "key 0x0A is currently being pressed\n";
     GTCOUT << "V0 should be set to the value of the key being pressed";
     chip8.LD_Vx_k();
 
-    EXPECT_EQ(chip8.m_V[keyPressed], keyPressed); // key[0x0A] = V[10]
+    EXPECT_EQ(chip8.m_state.V[keyPressed], keyPressed); // key[0x0A] = V[10]
     chip8.x = 0x0;
 }
 
 // LD_t_Vx - set delay timer to Vx (opcode 0xFx15)
 TEST_F(Chip8Tests, Test_LD_t_Vx) {
-    chip8.m_V[0] = 0x0A;
+    chip8.m_state.V[0] = 0x0A;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
 
     GTCOUT << "delay timer should be set to V0";
-    chip8.LD_t_Vx(chip8.m_delayTimer);
+    chip8.LD_t_Vx(chip8.m_state.delayTimer);
 
-    EXPECT_EQ(chip8.m_delayTimer, chip8.m_V[0]);
+    EXPECT_EQ(chip8.m_state.delayTimer, chip8.m_state.V[0]);
 }
 
 // ADD_I_Vx - set index (I) to I + Vx (opcode 0xFx1E)
 TEST_F(Chip8Tests, Test_ADD_I_Vx) {
-    chip8.m_index = 0x0A;
-    chip8.m_V[0] = 0x0B;
+    chip8.m_state.index = 0x0A;
+    chip8.m_state.V[0] = 0x0B;
 
-    GTCOUT << "I is currently equal to: " << chip8.m_index;
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "I is currently equal to: " << chip8.m_state.index;
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
 
     GTCOUT << "I should be set to I + V0";
     chip8.ADD_I_Vx();
 
-    EXPECT_EQ(chip8.m_index, 0x15);
+    EXPECT_EQ(chip8.m_state.index, 0x15);
 }
 
 // LD_F_Vx - set index (I) to location of sprite for digit Vx (opcode 0xFx29)
 TEST_F(Chip8Tests, Test_LD_F_Vx) {
-    chip8.m_V[0] = 0x0A;
-    int sum = chip8.m_V[0] * 0x5;
+    chip8.m_state.V[0] = 0x0A;
+    int sum = chip8.m_state.V[0] * 0x5;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
     GTCOUT << "I should be set to the location of the sprite for digit V0";
     GTCOUT << "i.e., I = Vx * 0x5 = " << sum;
     chip8.LD_F_Vx();
 
-    EXPECT_EQ(chip8.m_index, sum);
+    EXPECT_EQ(chip8.m_state.index, sum);
 }
 
 // LD_BCD - store BCD representation of Vx in memory locations I, I+1, and I+2 (opcode 0xFx33)
 TEST_F(Chip8Tests, Test_LD_BCD) {
-    chip8.m_V[0] = 0xFF; // = 255
-    chip8.m_index = 0x0;
+    chip8.m_state.V[0] = 0xFF; // = 255
+    chip8.m_state.index = 0x0;
 
-    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_V[0]);
-    GTCOUT << "I is currently equal to: " << chip8.m_index;
+    GTCOUT << "V0 is currently equal to: " << static_cast<int>(chip8.m_state.V[0]);
+    GTCOUT << "I is currently equal to: " << chip8.m_state.index;
 
     GTCOUT << "BCD representation of V0 should be stored in memory locations I, I+1, and I+2";
-    GTCOUT << "i.e., I = V0 / 100 = " << chip8.m_V[0] / 100 << ", I+1 = (V0 / 10) % 10 = " << (chip8.m_V[0] / 10) % 10 << ", I+2 = V0 % 10 = " << chip8.m_V[0] % 10;
+    GTCOUT << "i.e., I = V0 / 100 = " << chip8.m_state.V[0] / 100 << ", I+1 = (V0 / 10) % 10 = " << (chip8.m_state.V[0] / 10) % 10 << ", I+2 = V0 % 10 = " << chip8.m_state.V[0] % 10;
     chip8.LD_BCD();
 
-    EXPECT_EQ(chip8.m_memory[0], 0x2);  // 255 / 100 = 2
-    EXPECT_EQ(chip8.m_memory[1], 0x5);  // (255 / 10) = 25.5, 25.5 % 10 = 5
-    EXPECT_EQ(chip8.m_memory[2], 0x5);  // 255 % 10 = 5
+    EXPECT_EQ(chip8.m_state.memory[0], 0x2);  // 255 / 100 = 2
+    EXPECT_EQ(chip8.m_state.memory[1], 0x5);  // (255 / 10) = 25.5, 25.5 % 10 = 5
+    EXPECT_EQ(chip8.m_state.memory[2], 0x5);  // 255 % 10 = 5
 }
 
 // LD_wVF - store registers V0 through Vx in memory starting at location I (opcode 0xFx55)
 TEST_F(Chip8Tests, Test_LD_wVF) {
     chip8.x = 0x0;
     for (int i = 0; i < chip8.x; ++i) {
-        chip8.m_V[i] = i;
+        chip8.m_state.V[i] = i;
     }
 
-    GTCOUT << "I is currently equal to: " << chip8.m_index;
+    GTCOUT << "I is currently equal to: " << chip8.m_state.index;
     GTCOUT << "V0 through V4 should be stored in memory starting at location I";
     chip8.LD_wVF();
 
     for (int i = 0; i < chip8.x; ++i) {
-        EXPECT_EQ(chip8.m_memory[chip8.m_index + i], i);
+        EXPECT_EQ(chip8.m_state.memory[chip8.m_state.index + i], i);
     }   
     chip8.x = 0x5; 
 }
 
 // LD_rVF - read registers V0 through Vx from memory starting at location I (opcode 0xFx65)
 TEST_F(Chip8Tests, Test_LD_rVF) {
-    chip8.m_index = 0x0;
+    chip8.x = 0x4;
+    chip8.m_state.index = 0x0;
     for (int i = 0; i < 0x5; ++i) {
-        chip8.m_memory[i] = i;
+        chip8.m_state.memory[i] = i;
     }
 
-    GTCOUT << "I is currently equal to: " << chip8.m_index;
+    GTCOUT << "I is currently equal to: " << chip8.m_state.index;
     GTCOUT << "V0 through V4 should be read from memory starting at location I";
     chip8.LD_rVF();
 
     for (int i = 0; i < 0x5; ++i) {
-        EXPECT_EQ(chip8.m_V[i], i);
+        EXPECT_EQ(chip8.m_state.V[i], i);
+    }
+}
+
+// decode cache - cycle() should execute the predecoded instruction at PC
+TEST_F(Chip8Tests, Test_DecodeCache) {
+    chip8.m_state.memory[0x200] = 0x60;           // 6005 : LD V0, 0x05
+    chip8.m_state.memory[0x201] = 0x05;
+    chip8.m_state.memory[0x202] = 0x12;           // 1200 : JP 0x200
+    chip8.m_state.memory[0x203] = 0x00;
+    chip8.m_state.pc = 0x200;
+
+    GTCOUT << "running LD V0, 0x05 followed by JP 0x200 twice";
+    for (int i = 0; i < 4; ++i)
+        chip8.cycle();
+
+    EXPECT_EQ(chip8.m_state.V[0], 0x05);
+    EXPECT_EQ(chip8.m_state.pc, 0x200);
+    EXPECT_EQ(chip8.decoded(0).opcode, 0x6005);
+    EXPECT_EQ(chip8.decoded(1).opcode, 0x1200);
+}
+
+// decode cache - writes into code through Fx55 should invalidate the cached instruction
+TEST_F(Chip8Tests, Test_DecodeCache_Invalidate) {
+    chip8.m_state.memory[0x200] = 0x60;           // 6005 : LD V0, 0x05
+    chip8.m_state.memory[0x201] = 0x05;
+    chip8.m_state.pc = 0x200;
+    chip8.cycle();
+    EXPECT_EQ(chip8.m_state.V[0], 0x05);
+
+    GTCOUT << "overwriting 0x200 with 0x61 so the instruction becomes LD V1, 0x05";
+    chip8.m_state.V[0] = 0x61;
+    chip8.m_state.index = 0x200;
+    chip8.x = 0x0;
+    chip8.LD_wVF();
+
+    chip8.m_state.pc = 0x200;
+    chip8.cycle();
+
+    EXPECT_EQ(chip8.m_state.V[1], 0x05);
+    EXPECT_EQ(chip8.decoded(0).opcode, 0x6105);
+}
+
+// run - executing basic blocks should match stepping through cycle() one instruction at a time
+TEST_F(Chip8Tests, Test_Run) {
+    loadProgram({
+        0x6000,                             // 0x200 : LD V0, 0x00
+        0x7001,                             // 0x202 : ADD V0, 0x01
+        0x3005,                             // 0x204 : SE V0, 0x05
+        0x1202,                             // 0x206 : JP 0x202
+        0x6107,                             // 0x208 : LD V1, 0x07
+        0x120A,                             // 0x20A : JP 0x20A
+    });
+
+    Chip8 stepped;
+    stepped.reset();
+    for (int i = 0; i < 0x10; ++i)
+        stepped.m_state.memory[0x200 + i] = chip8.m_state.memory[0x200 + i];
+    stepped.m_state.pc = 0x200;
+
+    GTCOUT << "counting V0 up to 5 with run(), then comparing against cycle()";
+    EXPECT_EQ(chip8.run(100), 100u);
+    for (int i = 0; i < 100; ++i)
+        stepped.cycle();
+
+    EXPECT_EQ(chip8.m_state.V[0], 0x05);
+    EXPECT_EQ(chip8.m_state.V[1], 0x07);
+    EXPECT_EQ(chip8.m_state.pc, 0x20A);
+    EXPECT_EQ(chip8.m_state.V, stepped.m_state.V);
+    EXPECT_EQ(chip8.m_state.pc, stepped.m_state.pc);
+#ifndef CHIP8_THREADED_DISPATCH
+    EXPECT_EQ(chip8.decoded(0).blockLen, 3);   // 6000, 7001, 3005
+#endif
+}
+
+// runUntilFrame - should run exactly one frame's worth of instructions and tick the timers once
+TEST_F(Chip8Tests, Test_RunUntilFrame) {
+    loadProgram({
+        0x6000,                             // 0x200 : LD V0, 0x00
+        0xA000,                             // 0x202 : LD I, 0x000
+        0xD005,                             // 0x204 : DRW V0, V0, 5
+        0x6101,                             // 0x206 : LD V1, 0x01
+        0x1208,                             // 0x208 : JP 0x208
+    });
+    chip8.drawFlag = false;
+    chip8.m_state.delayTimer = 0x05;
+
+    EXPECT_EQ(chip8.runUntilFrame(), chip8.cyclesPerFrame());
+    EXPECT_EQ(chip8.drawFlag, true);
+    EXPECT_EQ(chip8.m_state.pc, 0x208);
+    EXPECT_EQ(chip8.m_state.V[1], 0x01);
+    EXPECT_EQ(chip8.m_state.delayTimer, 0x04);
+    EXPECT_EQ(chip8.m_state.frameCycles, 0u);
+    EXPECT_EQ(chip8.m_state.cycles, chip8.cyclesPerFrame());
+}
+
+// timers - should tick at 60 Hz of emulated time, independent of the clock speed
+TEST_F(Chip8Tests, Test_Timers) {
+    loadProgram({
+        0x1200,                             // 0x200 : JP 0x200
+    });
+    chip8.setClockSpeed(600);
+    chip8.m_state.delayTimer = 0x05;
+    chip8.m_state.soundTimer = 0x01;
+
+    GTCOUT << "at 600 instructions per second the timers should tick every 10 cycles";
+    EXPECT_EQ(chip8.clockSpeed(), 600u);
+    EXPECT_EQ(chip8.cyclesPerFrame(), 10u);
+
+    for (int i = 0; i < 9; ++i)
+        chip8.cycle();
+    EXPECT_EQ(chip8.m_state.delayTimer, 0x05);
+
+    chip8.cycle();
+    EXPECT_EQ(chip8.m_state.delayTimer, 0x04);
+    EXPECT_EQ(chip8.m_state.soundTimer, 0x00);
+
+    EXPECT_EQ(chip8.run(25), 25u);
+    EXPECT_EQ(chip8.m_state.delayTimer, 0x02);
+    EXPECT_EQ(chip8.m_state.soundTimer, 0x00);
+    EXPECT_EQ(chip8.m_state.frameCycles, 5u);
+    EXPECT_EQ(chip8.m_state.cycles, 35u);
+}
+
+// run - a block that overwrites the code after it should pick up the new instruction
+TEST_F(Chip8Tests, Test_Run_SelfModifying) {
+    loadProgram({
+        0x6061,                             // 0x200 : LD V0, 0x61
+        0xA206,                             // 0x202 : LD I, 0x206
+        0xF055,                             // 0x204 : LD [I], V0      (0x206 becomes 0x6105)
+        0x6005,                             // 0x206 : LD V0, 0x05
+        0x1208,                             // 0x208 : JP 0x208
+    });
+    chip8.buildBlock((0x206 - 0x200) >> 1);
+
+    EXPECT_EQ(chip8.run(4), 4u);
+    EXPECT_EQ(chip8.m_state.V[0], 0x61);
+    EXPECT_EQ(chip8.m_state.V[1], 0x05);
+}
+
+// ROM images - instances sharing one decode should run like a plain load, and copy only the
+// pages they write
+TEST_F(Chip8Tests, Test_RomImage) {
+    const std::uint8_t program[] = {
+        0x60, 0x61,                         // 0x200 : LD V0, 0x61
+        0xA2, 0x06,                         // 0x202 : LD I, 0x206
+        0xF0, 0x55,                         // 0x204 : LD [I], V0      (0x206 becomes 0x6105)
+        0x60, 0x05,                         // 0x206 : LD V0, 0x05
+        0x12, 0x08,                         // 0x208 : JP 0x208
+    };
+    auto image = Chip8::loadImage(program, sizeof(program));
+    ASSERT_TRUE(image);
+    EXPECT_EQ(image->size(), sizeof(program));
+
+    Chip8 writer, reader;
+    ASSERT_TRUE(writer.loadROM(image));
+    ASSERT_TRUE(reader.loadROM(image));
+    EXPECT_EQ(writer.decoded(3).opcode, 0x6005);
+
+    EXPECT_EQ(writer.run(4), 4u);
+    EXPECT_EQ(writer.m_state.V[0], 0x61);
+    EXPECT_EQ(writer.m_state.V[1], 0x05);
+    EXPECT_NE(writer.m_pages[0], reader.m_pages[0]);
+    EXPECT_EQ(writer.m_pages[1], reader.m_pages[1]);
+    EXPECT_EQ(reader.decoded(3).opcode, 0x6005);      // the shared page is untouched
+
+    EXPECT_EQ(reader.run(4), 4u);
+    EXPECT_EQ(reader.m_state.V[1], 0x05);
+    EXPECT_FALSE(Chip8::loadImage(program, 0x1000 - 0x200 + 1));
+
+    GTCOUT << "Pong from an image vs. a plain load";
+    std::ifstream file(CHIP8_ROM_DIR "/Pong.ch8", std::ios::binary);
+    std::vector<std::uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    image = Chip8::loadImage(rom.data(), rom.size());
+    ASSERT_TRUE(chip8.loadROM(rom.data(), rom.size(), 5));
+    ASSERT_TRUE(writer.loadROM(image, 5));
+
+    for (int i = 0; i < 100; ++i) {
+        chip8.runUntilFrame();
+        writer.runUntilFrame();
+    }
+    EXPECT_EQ(machineState(writer), machineState(chip8));
+
+    std::size_t shared = 0;
+    ASSERT_TRUE(reader.loadROM(image));
+    for (std::size_t page = 0; page < Chip8::kPages; ++page)
+        shared += writer.m_pages[page] == reader.m_pages[page];
+    GTCOUT << shared << " of " << Chip8::kPages << " decode pages still shared after 100 frames";
+    EXPECT_GE(shared, Chip8::kPages - 1);
+}
+
+// rom library - one mapping and image per distinct ROM, packs round-trip, loads match file loads
+TEST_F(Chip8Tests, Test_RomLibrary) {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "chip8_test_library";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "copies");
+    std::filesystem::copy_file(CHIP8_ROM_DIR "/Maze.ch8", dir / "a.ch8");
+    std::filesystem::copy_file(CHIP8_ROM_DIR "/Maze.ch8", dir / "copies" / "maze.ch8");
+    std::ofstream(dir / "big.ch8", std::ios::binary) << std::string(0x1000 - 0x200 + 1, '\x12');
+    std::ofstream(dir / "notes.txt") << "not a ROM";
+
+    RomLibrary roms;
+    ASSERT_TRUE(roms.add(dir.string()));
+    ASSERT_EQ(roms.entries().size(), 3u);
+    const RomLibrary::Entry* maze = roms.find((dir / "a.ch8").string());
+    const RomLibrary::Entry* copy = roms.find((dir / "copies" / "maze.ch8").string());
+    const RomLibrary::Entry* big = roms.find((dir / "big.ch8").string());
+    ASSERT_TRUE(maze && copy && big);
+
+    EXPECT_EQ(maze->hash, RomLibrary::hash(maze->data, maze->size));
+    EXPECT_EQ(roms.find(maze->hash), maze);
+    EXPECT_EQ(copy->image, maze->image);                // same bytes, decoded once
+    EXPECT_FALSE(big->image);
+    EXPECT_EQ(roms.find(big->hash), nullptr);
+    EXPECT_FALSE(chip8.loadROM((dir / "big.ch8").string().c_str()));
+    EXPECT_FALSE(roms.add((dir / "missing.ch8").string()));
+
+    GTCOUT << "packing the library and mapping the pack";
+    const std::string pack = (dir / "corpus.ch8pack").string();
+    ASSERT_TRUE(roms.writePack(pack));
+    RomLibrary packed;
+    ASSERT_TRUE(packed.add(pack));
+    ASSERT_EQ(packed.entries().size(), roms.entries().size());
+    for (const RomLibrary::Entry& entry : roms.entries()) {
+        const RomLibrary::Entry* other = packed.find(entry.name);
+        ASSERT_TRUE(other);
+        EXPECT_EQ(other->hash, entry.hash);
+        EXPECT_EQ(static_cast<bool>(other->image), static_cast<bool>(entry.image));
+    }
+
+    GTCOUT << "Maze from the pack vs. loadROM() from the file";
+    Chip8 fromFile;
+    ASSERT_TRUE(fromFile.loadROM(CHIP8_ROM_DIR "/Maze.ch8", 3));
+    ASSERT_TRUE(chip8.loadROM(packed.find(maze->hash)->image, 3));
+    for (int i = 0; i < 60; ++i) {
+        fromFile.runUntilFrame();
+        chip8.runUntilFrame();
+    }
+    EXPECT_EQ(machineState(chip8), machineState(fromFile));
+
+    // reloading reuses the pages a lazily decoded run filled instead of allocating new ones.
+    // cycle() decodes through the pages whichever engine run() is built with
+    fromFile.cycle();
+    std::array<const void*, Chip8::kPages> owned;
+    for (std::size_t page = 0; page < Chip8::kPages; ++page)
+        owned[page] = fromFile.m_owned[page].get();
+    EXPECT_TRUE(owned[0]);
+    ASSERT_TRUE(fromFile.loadROM(maze->image, 3));
+    fromFile.cycle();
+    ASSERT_TRUE(fromFile.loadROM(CHIP8_ROM_DIR "/Maze.ch8", 3));
+    fromFile.cycle();
+    for (std::size_t page = 0; page < Chip8::kPages; ++page)
+        EXPECT_EQ(fromFile.m_owned[page].get(), owned[page]);
+
+    std::filesystem::remove_all(dir);
+}
+
+// idle loops - skipping a delay timer poll should land exactly where stepping through it does
+TEST_F(Chip8Tests, Test_IdleLoop) {
+    loadProgram({
+        0x6305,                             // 0x200 : LD V3, 5
+        0xF315,                             // 0x202 : LD DT, V3
+        0xF307,                             // 0x204 : LD V3, DT
+        0x3300,                             // 0x206 : SE V3, 0
+        0x1204,                             // 0x208 : JP 0x204
+        0x120A,                             // 0x20A : JP 0x20A
+    });
+    Chip8 stepped, threaded;
+    stepped.m_state = threaded.m_state = chip8.m_state;
+
+    for (int i = 0; i < 600; ++i)
+        stepped.cycle();
+    EXPECT_EQ(chip8.runBlocks(600, false), 600u);
+    EXPECT_EQ(threaded.runThreaded(600, false), 600u);
+    EXPECT_EQ(stepped.m_state.pc, 0x20A);
+    EXPECT_EQ(machineState(chip8), machineState(stepped));
+    EXPECT_EQ(machineState(threaded), machineState(stepped));
+
+    GTCOUT << "only whole iterations are skipped, and only while the loop can't exit";
+    chip8.m_state.pc = 0x204;
+    chip8.m_state.delayTimer = 5;
+    EXPECT_EQ(chip8.skipIdle(12), 12u);
+    EXPECT_EQ(chip8.skipIdle(11), 9u);
+    EXPECT_EQ(chip8.m_state.V[3], 5);
+    chip8.m_state.delayTimer = 0;
+    EXPECT_EQ(chip8.skipIdle(12), 0u);
+    chip8.m_state.pc = 0x20A;
+    EXPECT_EQ(chip8.skipIdle(7), 7u);
+}
+
+// idle loops - Fx0A with no key down burns the rest of the frame, a key press ends it
+TEST_F(Chip8Tests, Test_IdleLoop_Key) {
+    loadProgram({ 0xF20A });                // 0x200 : LD V2, K
+
+    EXPECT_EQ(chip8.runUntilFrame(), chip8.cyclesPerFrame());
+    EXPECT_EQ(chip8.run(1000), 1000u);
+    EXPECT_EQ(chip8.m_state.pc, 0x200);
+    EXPECT_EQ(chip8.m_state.cycles, 1000u + chip8.cyclesPerFrame());
+
+    chip8.setKey(0x7, true);
+    EXPECT_EQ(chip8.run(1), 1u);
+    EXPECT_EQ(chip8.m_state.V[2], 0x7);
+    EXPECT_EQ(chip8.m_state.pc, 0x202);
+}
+
+// input queue - a key event should land before the same instruction however the run is split
+TEST_F(Chip8Tests, Test_InputQueue) {
+    const std::vector<std::function<void()>> splits = {
+        [&] { chip8.run(300); },
+        [&] { while (chip8.m_state.cycles < 300) chip8.run(5); },
+        [&] { while (chip8.m_state.cycles < 300) chip8.runUntilFrame(); },
+        [&] { for (int i = 0; i < 300; ++i) chip8.cycle(); },
+    };
+
+    // off until asked for, so instances that only use setKey() don't carry it
+    EXPECT_FALSE(chip8.queueKey({ 100, 0x0, true }));
+    chip8.enableInputQueue();
+
+    for (std::size_t i = 0; i < splits.size(); ++i) {
+        chip8.reset();
+        loadProgram({
+            0x7101,                         // 0x200 : ADD V1, 1
+            0xE0A1,                         // 0x202 : SKNP V0
+            0x1208,                         // 0x204 : JP 0x208
+            0x1200,                         // 0x206 : JP 0x200
+            0x1208,                         // 0x208 : JP 0x208
+        });
+        ASSERT_TRUE(chip8.queueKey({ 100, 0x0, true }));
+        ASSERT_TRUE(chip8.queueKey({ 250, 0x0, false }));
+
+        splits[i]();
+        // SKNP runs at cycles 1, 4, 7, ... so the first to see the key is number 100
+        EXPECT_EQ(chip8.m_state.cycles, 300u) << "split " << i;
+        EXPECT_EQ(chip8.m_state.V[1], 34) << "split " << i;
+        EXPECT_EQ(chip8.m_state.pc, 0x208) << "split " << i;
+        EXPECT_EQ(chip8.m_state.key[0x0], 0) << "split " << i;
+    }
+
+    GTCOUT << "filling the queue, then dropping it with a reset";
+    for (std::size_t i = 0; i < Chip8::kInputQueueSize; ++i)
+        ASSERT_TRUE(chip8.queueKey({ 1000 + i, 0x5, (i & 1) == 0 }));
+    EXPECT_FALSE(chip8.queueKey({ 5000, 0x5, true }));
+
+    chip8.reset();
+    EXPECT_TRUE(chip8.queueKey({ 5000, 0x5, true }));
+    chip8.flushInput();
+    EXPECT_EQ(chip8.m_state.key[0x5], 1);
+    EXPECT_EQ(chip8.m_state.cycles, 0u);
+}
+
+// snapshots - restoring a State should replay exactly the same execution
+TEST_F(Chip8Tests, Test_SaveState) {
+    ASSERT_TRUE(chip8.loadROM(CHIP8_ROM_DIR "/Tetris.ch8", 7));
+    chip8.run(5000);
+
+    Chip8::State snapshot;
+    chip8.saveState(snapshot);
+    chip8.run(5000);
+    std::vector<std::uint8_t> expected = machineState(chip8);
+
+    GTCOUT << "loading the snapshot back and running the same 5000 cycles again";
+    chip8.loadState(snapshot);
+    EXPECT_EQ(chip8.m_state.cycles, 5000u);
+    chip8.run(5000);
+    EXPECT_EQ(machineState(chip8), expected);
+
+    Chip8 fork;
+    fork.loadState(snapshot);
+    fork.run(5000);
+    EXPECT_EQ(machineState(fork), expected);
+}
+
+// snapshots - the byte format should round-trip and reject anything malformed
+TEST_F(Chip8Tests, Test_SaveState_Serialized) {
+    ASSERT_TRUE(chip8.loadROM(CHIP8_ROM_DIR "/Pong.ch8", 3));
+    chip8.run(3000);
+
+    std::vector<std::uint8_t> buffer(Chip8::kSnapshotSize);
+    EXPECT_EQ(chip8.saveState(buffer.data(), buffer.size() - 1), 0u);
+    ASSERT_EQ(chip8.saveState(buffer.data(), buffer.size()), Chip8::kSnapshotSize);
+    EXPECT_EQ(std::string(buffer.begin(), buffer.begin() + 4), "C8ST");
+
+    Chip8 restored;
+    EXPECT_FALSE(restored.loadState(buffer.data(), buffer.size() - 1));
+    ASSERT_TRUE(restored.loadState(buffer.data(), buffer.size()));
+    EXPECT_EQ(machineState(restored), machineState(chip8));
+
+    restored.run(3000);
+    chip8.run(3000);
+    EXPECT_EQ(machineState(restored), machineState(chip8));
+
+    buffer[4] = Chip8::kSnapshotVersion + 1;
+    EXPECT_FALSE(restored.loadState(buffer.data(), buffer.size()));
+}
+
+// snapshots - code that differs between the snapshot and the machine must not run stale decodes
+TEST_F(Chip8Tests, Test_SaveState_Invalidate) {
+    loadProgram({
+        0x6001,                             // 0x200 : LD V0, 0x01
+        0x1202,                             // 0x202 : JP 0x202
+    });
+    Chip8::State snapshot;
+    chip8.saveState(snapshot);
+    snapshot.memory[0x201] = 0x02;          // 0x200 : LD V0, 0x02
+
+    chip8.cycle();
+    EXPECT_EQ(chip8.m_state.V[0], 0x01);
+    EXPECT_EQ(chip8.decoded(0).handler, Chip8::op_LD_Vx_byte);
+
+    chip8.loadState(snapshot);
+    chip8.cycle();
+    EXPECT_EQ(chip8.m_state.V[0], 0x02);
+}
+
+// rewind - popping should give back every recorded frame, newest first, bit for bit
+TEST_F(Chip8Tests, Test_Rewind) {
+    ASSERT_TRUE(chip8.loadROM(CHIP8_ROM_DIR "/Tetris.ch8", 5));
+    Rewind rewind;
+    std::vector<std::vector<std::uint8_t>> recorded;
+
+    for (int frame = 0; frame < 300; ++frame) {
+        chip8.setKey(frame / 20 % 16, frame % 20 < 10);
+        chip8.runUntilFrame();
+        rewind.push(chip8.state());
+        recorded.push_back(machineState(chip8));
+    }
+
+    GTCOUT << "300 frames take " << rewind.bytesUsed() << " bytes instead of " << 300 * sizeof(Chip8::State);
+    EXPECT_EQ(rewind.frames(), 300u);
+    EXPECT_LT(rewind.bytesUsed(), 300 * sizeof(Chip8::State) / 4);
+
+    Chip8::State state;
+    for (int frame = 299; frame >= 150; --frame) {
+        ASSERT_TRUE(rewind.pop(state));
+        chip8.loadState(state);
+        ASSERT_EQ(machineState(chip8), recorded[frame]) << "frame " << frame;
+    }
+
+    GTCOUT << "recording again after rewinding should carry on from the restored frame";
+    chip8.runUntilFrame();
+    rewind.push(chip8.state());
+    ASSERT_TRUE(rewind.pop(state));
+    EXPECT_EQ(std::memcmp(&state, &chip8.state(), sizeof(state)), 0);
+    ASSERT_TRUE(rewind.pop(state));
+    chip8.loadState(state);
+    EXPECT_EQ(machineState(chip8), recorded[149]);
+}
+
+// rewind - a full ring should drop the oldest frames and keep the newest ones intact
+TEST_F(Chip8Tests, Test_Rewind_Wraparound) {
+    ASSERT_TRUE(chip8.loadROM(CHIP8_ROM_DIR "/ParticleDemo.ch8", 1));
+    Rewind rewind(64 * 1024);
+    std::vector<std::vector<std::uint8_t>> recorded;
+
+    for (int frame = 0; frame < 2000; ++frame) {
+        chip8.runUntilFrame();
+        rewind.push(chip8.state());
+        recorded.push_back(machineState(chip8));
+        ASSERT_LE(rewind.bytesUsed(), 64u * 1024);
+    }
+
+    std::size_t kept = rewind.frames();
+    GTCOUT << "a 64 KB ring keeps the last " << kept << " frames";
+    EXPECT_GT(kept, Rewind::kKeyframeInterval);
+    EXPECT_LT(kept, 2000u);
+
+    Chip8::State state;
+    for (std::size_t i = 0; i < kept; ++i) {
+        ASSERT_TRUE(rewind.pop(state));
+        chip8.loadState(state);
+        ASSERT_EQ(machineState(chip8), recorded[recorded.size() - 1 - i]);
+    }
+    EXPECT_FALSE(rewind.pop(state));
+}
+
+// trace - records should survive the chunk ring and the background writer unchanged
+TEST_F(Chip8Tests, Test_Trace_RoundTrip) {
+    const std::string path = (std::filesystem::temp_directory_path() / "chip8_test_roundtrip.trace").string();
+    std::mt19937 rng(3);
+    std::vector<TraceRecord> written;
+
+    {
+        TraceWriter writer(path, 64, 2);        // tiny chunks so the ring wraps constantly
+        ASSERT_TRUE(writer.ok());
+
+        std::array<std::uint8_t, 16> V{};
+        for (int i = 0; i < 10000; ++i) {
+            std::array<std::uint8_t, 16> before = V;
+            TraceRecord r{};
+            r.pc = rng() & 0xFFF;
+            r.opcode = rng() & 0xFFFF;
+            r.index = rng() & 0xFFF;
+            for (int n = rng() % 3; n > 0; --n)
+                V[rng() % 16] = rng() & 0xFF;
+
+            for (int v = 0; v < 16; ++v) {
+                if (V[v] != before[v]) {
+                    r.changed |= 1 << v;
+                    r.V[v] = V[v];
+                }
+            }
+            writer.record(r.pc, r.opcode, r.index, before.data(), V.data());
+            written.push_back(r);
+        }
+    }
+
+    TraceReader reader(path);
+    ASSERT_TRUE(reader.ok());
+
+    TraceRecord r;
+    for (const TraceRecord& expected : written) {
+        ASSERT_TRUE(reader.next(r));
+        ASSERT_EQ(r.pc, expected.pc);
+        ASSERT_EQ(r.opcode, expected.opcode);
+        ASSERT_EQ(r.index, expected.index);
+        ASSERT_EQ(r.changed, expected.changed);
+        ASSERT_EQ(r.V, expected.V);
+    }
+    EXPECT_FALSE(reader.next(r));
+
+    std::filesystem::remove(path);
+}
+
+#ifdef CHIP8_TRACE
+// trace - a traced run() should log exactly the instructions cycle() steps through
+TEST_F(Chip8Tests, Test_Trace_Run) {
+    const std::string path = (std::filesystem::temp_directory_path() / "chip8_test_run.trace").string();
+    ASSERT_TRUE(chip8.loadROM(CHIP8_ROM_DIR "/Tetris.ch8"));
+    ASSERT_TRUE(chip8.setBackend(Chip8::Backend::Jit) || !Jit::available());
+
+    {
+        TraceWriter writer(path);
+        chip8.setTracer(&writer);
+        EXPECT_EQ(chip8.run(20000), 20000u);
+        chip8.setTracer(nullptr);
+    }
+
+    Chip8 stepped;
+    ASSERT_TRUE(stepped.loadROM(CHIP8_ROM_DIR "/Tetris.ch8"));
+    TraceReader reader(path);
+    TraceRecord r;
+
+    for (int i = 0; i < 20000; ++i) {
+        ASSERT_TRUE(reader.next(r));
+        ASSERT_EQ(r.pc, stepped.m_state.pc) << "instruction " << i;
+        stepped.cycle();
+        ASSERT_EQ(r.index, stepped.m_state.index) << "instruction " << i;
+    }
+    EXPECT_FALSE(reader.next(r));
+    EXPECT_EQ(machineState(stepped), machineState(chip8));
+
+    std::filesystem::remove(path);
+}
+#endif
+
+#ifdef CHIP8_PROFILE
+// profile - every instruction counted once whichever way it was dispatched, DRW counters match
+TEST_F(Chip8Tests, Test_Profile) {
+    ASSERT_TRUE(chip8.loadROM(CHIP8_ROM_DIR "/Tetris.ch8"));
+    EXPECT_EQ(chip8.run(20000), 20000u);
+
+    Chip8 stepped;
+    ASSERT_TRUE(stepped.loadROM(CHIP8_ROM_DIR "/Tetris.ch8"));
+    for (int i = 0; i < 20000; ++i)
+        stepped.cycle();
+
+    const Chip8::Profile& p = chip8.profile();
+    std::uint64_t classes = 0, pcs = 0;
+    for (std::uint64_t n : p.classes)
+        classes += n;
+    for (std::uint64_t n : p.pcHits)
+        pcs += n;
+
+    EXPECT_EQ(classes, 20000u);
+    EXPECT_EQ(pcs, 20000u);
+    EXPECT_EQ(p.frames, 20000u / chip8.cyclesPerFrame());
+    EXPECT_EQ(p.draws, p.classes[Chip8::op_DRW]);
+    EXPECT_GT(p.pixels, 0u);
+    EXPECT_EQ(p.classes, stepped.profile().classes);
+    EXPECT_EQ(p.pcHits, stepped.profile().pcHits);
+
+    ASSERT_TRUE(chip8.loadROM(CHIP8_ROM_DIR "/Tetris.ch8"));
+    EXPECT_EQ(chip8.profile().frames, 0u);
+}
+#endif
+
+// JIT - every compilable opcode should leave the machine exactly as the interpreter does
+TEST_F(Chip8Tests, Test_Jit_Opcodes) {
+    if (!Jit::available())
+        GTEST_SKIP() << "JIT backend isn't available on this host";
+
+    const std::uint16_t opcodes[] = {
+        0x6A5C, 0x6F01, 0x7A80, 0x7FFF, 0xA123, 0xF31E, 0xFF1E, 0xF429, 0x1206, 0xB202,
+        0x3A01, 0x4A01, 0x5120, 0x9120, 0x5AA0, 0x9FF0,
+    };
+    const std::uint8_t pairs[][2] = { {0x1, 0x2}, {0xF, 0x3}, {0x3, 0xF}, {0x4, 0x4}, {0xF, 0xF} };
+    const std::uint8_t edges[] = { 0x00, 0x01, 0x02, 0x0F, 0x10, 0x7F, 0x80, 0xFE, 0xFF };
+
+    std::vector<std::uint16_t> cases(std::begin(opcodes), std::end(opcodes));
+    for (std::uint16_t n : { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE })
+        for (const auto& p : pairs)
+            cases.push_back(0x8000 | p[0] << 8 | p[1] << 4 | n);
+
+    std::mt19937 rng(8);
+    for (std::uint16_t opcode : cases) {
+        for (int round = 0; round < 64; ++round) {
+            Chip8 jit;
+            jit.reset();
+            ASSERT_TRUE(jit.setBackend(Chip8::Backend::Jit));
+            chip8.reset();
+
+            // the opcode under test followed by jump-to-self loops
+            chip8.m_state.memory[0x200] = opcode >> 8;
+            chip8.m_state.memory[0x201] = opcode & 0xFF;
+            for (std::uint16_t address = 0x202; address < 0x210; address += 2) {
+                chip8.m_state.memory[address]     = 0x10 | address >> 8;
+                chip8.m_state.memory[address + 1] = address & 0xFF;
+            }
+            for (int i = 0; i < 16; ++i)
+                chip8.m_state.V[i] = (rng() & 1) ? edges[rng() % sizeof(edges)] : rng() & 0xFF;
+            chip8.m_state.index = (rng() & 1) ? 0xFF0 : rng() & 0xFFF;
+            chip8.m_state.pc = 0x200;
+
+            jit.m_state.memory = chip8.m_state.memory;
+            jit.m_state.V      = chip8.m_state.V;
+            jit.m_state.index  = chip8.m_state.index;
+            jit.m_state.pc     = chip8.m_state.pc;
+
+            chip8.run(2);
+            jit.run(2);
+
+            EXPECT_NE(jit.m_jit->lookup(0x200, jit.m_state.memory.data()).fn, nullptr);
+            ASSERT_EQ(machineState(jit), machineState(chip8)) << "opcode " << std::hex << opcode;
+        }
+    }
+}
+
+// JIT - compiled blocks must be dropped when the code they came from is overwritten
+TEST_F(Chip8Tests, Test_Jit_SelfModifying) {
+    if (!Jit::available())
+        GTEST_SKIP() << "JIT backend isn't available on this host";
+
+    loadProgram({
+        0x1208,                             // 0x200 : JP 0x208
+        0x6061,                             // 0x202 : LD V0, 0x61
+        0xA208,                             // 0x204 : LD I, 0x208
+        0xF055,                             // 0x206 : LD [I], V0      (0x208 becomes 0x6105)
+        0x6005,                             // 0x208 : LD V0, 0x05
+        0x3105,                             // 0x20A : SE V1, 0x05
+        0x1202,                             // 0x20C : JP 0x202
+        0x120E,                             // 0x20E : JP 0x20E
+    });
+    ASSERT_TRUE(chip8.setBackend(Chip8::Backend::Jit));
+
+    chip8.run(200);
+
+    EXPECT_EQ(chip8.m_state.V[0], 0x61);
+    EXPECT_EQ(chip8.m_state.V[1], 0x05);
+    EXPECT_EQ(chip8.m_state.pc, 0x20E);
+}
+
+// JIT - running every ROM under roms/ in lockstep with the interpreter
+TEST_F(Chip8Tests, Test_Jit_Lockstep) {
+    if (!Jit::available())
+        GTEST_SKIP() << "JIT backend isn't available on this host";
+
+    const int chunks = 2000;
+    const std::uint64_t chunkCycles = 97;   // odd, so chunk edges land inside blocks too
+
+    testing::internal::CaptureStderr();     // some test suite ROMs spin on unsupported opcodes
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(CHIP8_ROM_DIR)) {
+        if (entry.path().extension() != ".ch8")
+            continue;
+
+        const std::string path = entry.path().string();
+        std::vector<std::vector<std::uint8_t>> expected;
+
+        Chip8 interpreter;
+        ASSERT_TRUE(interpreter.loadROM(path.c_str()));
+        for (int i = 0; i < chunks; ++i) {
+            interpreter.run(chunkCycles);
+            expected.push_back(machineState(interpreter));
+        }
+
+        Chip8 jit;
+        ASSERT_TRUE(jit.loadROM(path.c_str()));
+        ASSERT_TRUE(jit.setBackend(Chip8::Backend::Jit));
+        for (int i = 0; i < chunks; ++i) {
+            jit.run(chunkCycles);
+            ASSERT_EQ(machineState(jit), expected[i]) << path << " diverged in chunk " << i;
+        }
+
+        GTCOUT << entry.path().filename().string() << ": " << chunks * chunkCycles << " cycles in lockstep";
+    }
+
+    testing::internal::GetCapturedStderr();
+}
+
+// threaded dispatch - should stay in lockstep with the basic-block interpreter on every ROM
+TEST_F(Chip8Tests, Test_Threaded_Lockstep) {
+    testing::internal::CaptureStderr();
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(CHIP8_ROM_DIR)) {
+        if (entry.path().extension() != ".ch8")
+            continue;
+
+        const std::string path = entry.path().string();
+        Chip8 blocks, threaded;
+        ASSERT_TRUE(blocks.loadROM(path.c_str()));
+        ASSERT_TRUE(threaded.loadROM(path.c_str()));
+
+        for (int i = 0; i < 500; ++i) {
+            blocks.runBlocks(101, false);
+            threaded.runThreaded(101, false);
+            ASSERT_EQ(machineState(threaded), machineState(blocks)) << path << " diverged in chunk " << i;
+        }
+    }
+
+    testing::internal::GetCapturedStderr();
+}
+
+// framebuffer - the SIMD kernels must expand exactly like the plain per-pixel loop
+TEST_F(Chip8Tests, Test_Framebuffer_Expand) {
+    GTCOUT << "expansion kernel: " << Framebuffer::kernel();
+    const Framebuffer::Palette palette = { 0xFF33FF66, 0xFF102030 };
+    std::mt19937_64 rng(1234);
+
+    std::array<std::uint64_t, 32> rows;
+    for (auto& row : rows)
+        row = rng();
+    rows[0] = 0;
+    rows[1] = ~0ULL;
+    rows[2] = 0x8000000000000001ULL;
+
+    // rows go to a wider surface, padding between them must stay untouched
+    const std::size_t pitch = 72;
+    std::vector<std::uint32_t> out(32 * pitch, 0xDEADBEEF);
+    Framebuffer::expandRows(rows.data(), rows.size(), out.data(), pitch, palette);
+
+    for (int row = 0; row < 32; ++row) {
+        for (int col = 0; col < 64; ++col) {
+            bool lit = (rows[row] >> (63 - col)) & 1;
+            ASSERT_EQ(out[row * pitch + col], lit ? palette.foreground : palette.background) << row << ", " << col;
+        }
+        EXPECT_EQ(out[row * pitch + 64], 0xDEADBEEF);
+    }
+
+    GTCOUT << "byte framebuffers, including a tail shorter than one vector";
+    std::vector<std::uint8_t> bytes(2048 + 5);
+    for (auto& b : bytes)
+        b = (rng() & 3) ? 0 : static_cast<std::uint8_t>(rng());
+    std::vector<std::uint32_t> argb(bytes.size() + 1, 0xDEADBEEF);
+    Framebuffer::expandBytes(bytes.data(), bytes.size(), argb.data(), palette);
+
+    for (std::size_t i = 0; i < bytes.size(); ++i)
+        ASSERT_EQ(argb[i], bytes[i] ? palette.foreground : palette.background) << i;
+    EXPECT_EQ(argb.back(), 0xDEADBEEF);
+}
+
+// triple buffer - the reader should only ever see whole, newer values, and finally the last one
+TEST_F(Chip8Tests, Test_TripleBuffer) {
+    TripleBuffer<std::array<std::uint64_t, 32>> frames;
+    EXPECT_FALSE(frames.update());
+
+    frames.back().fill(1);
+    frames.publish();
+    frames.back().fill(2);
+    frames.publish();
+    EXPECT_TRUE(frames.update());
+    EXPECT_EQ(frames.front()[31], 2u);          // the unread 1 was replaced
+    EXPECT_FALSE(frames.update());
+    EXPECT_EQ(frames.front()[0], 2u);
+
+    constexpr std::uint64_t kFrames = 200000;
+    std::thread producer([&] {
+        for (std::uint64_t n = 3; n <= kFrames; ++n) {
+            frames.back().fill(n);
+            frames.publish();
+        }
+    });
+
+    std::uint64_t last = 2, seen = 0;
+    while (last != kFrames) {
+        if (!frames.update())
+            continue;
+        const auto& frame = frames.front();
+        for (std::uint64_t row : frame)
+            ASSERT_EQ(row, frame[0]) << "torn frame";
+        ASSERT_GT(frame[0], last);
+        last = frame[0];
+        ++seen;
+    }
+    producer.join();
+
+    GTCOUT << "reader saw " << seen << " of " << kFrames - 2 << " frames";
+}
+
+// batch - every job should get its own result slot, whichever worker ran it
+TEST_F(Chip8Tests, Test_Batch) {
+    const std::string invalidRom = (std::filesystem::temp_directory_path() / "chip8_test_invalid.ch8").string();
+    {
+        std::ofstream file(invalidRom, std::ios::binary);
+        file.put(static_cast<char>(0xFF));          // 0x200 : FFFF (invalid)
+        file.put(static_cast<char>(0xFF));
+    }
+
+    std::vector<BatchJob> jobs;
+    for (int i = 0; i < 32; ++i) {
+        BatchJob job;
+        job.romPath = (i % 4 == 0) ? invalidRom
+                    : (i % 4 == 1) ? std::string(CHIP8_ROM_DIR) + "/does-not-exist.ch8"
+                    : std::string(CHIP8_ROM_DIR) + "/Maze.ch8";
+        job.frames = 30 + i;
+        jobs.push_back(job);
+    }
+
+    GTCOUT << "running " << jobs.size() << " jobs on 4 threads";
+    testing::internal::CaptureStderr();
+    std::vector<BatchResult> results = BatchRunner(4).run(jobs);
+    testing::internal::GetCapturedStderr();
+
+    ASSERT_EQ(results.size(), jobs.size());
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        const BatchResult& r = results[i];
+        if (i % 4 == 0) {
+            EXPECT_EQ(r.exit, BatchResult::Exit::InvalidOpcode);
+            EXPECT_EQ(r.frames, 1u);
+        }
+        else if (i % 4 == 1) {
+            EXPECT_EQ(r.exit, BatchResult::Exit::LoadFailed);
+            EXPECT_EQ(r.cycles, 0u);
+        }
+        else {
+            EXPECT_EQ(r.exit, BatchResult::Exit::Completed);
+            EXPECT_EQ(r.frames, jobs[i].frames);
+            EXPECT_EQ(r.cycles, jobs[i].frames * (Chip8::kDefaultClockSpeed / Chip8::kTimerHz));
+        }
+    }
+
+    std::filesystem::remove(invalidRom);
+}
+
+// batch - results should only depend on the job (ROM, seed, ...), not on threads or scheduling
+TEST_F(Chip8Tests, Test_Batch_Deterministic) {
+    std::vector<BatchJob> jobs;
+    for (const char* rom : { "Maze.ch8", "Pong.ch8", "Tetris.ch8" }) {
+        for (std::uint64_t seed = 0; seed < 4; ++seed) {
+            BatchJob job;
+            job.romPath = std::string(CHIP8_ROM_DIR) + "/" + rom;
+            job.frames = 120;
+            job.seed = seed;
+            jobs.push_back(job);
+        }
+    }
+
+    std::vector<BatchResult> parallel = BatchRunner(4).run(jobs);
+    std::vector<BatchResult> serial = BatchRunner(1).run(jobs);
+
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        EXPECT_EQ(parallel[i].exit, BatchResult::Exit::Completed);
+        EXPECT_EQ(parallel[i].frameHash, serial[i].frameHash) << jobs[i].romPath << " seed " << jobs[i].seed;
+        EXPECT_EQ(parallel[i].cycles, serial[i].cycles);
+    }
+
+    GTCOUT << "Maze.ch8 draws a random maze, so every seed should give a different screen";
+    EXPECT_NE(parallel[0].frameHash, parallel[1].frameHash);
+}
+
+// lockstep - every lane should end up exactly where its own scalar Chip8 does, grouped or evicted
+TEST_F(Chip8Tests, Test_Lockstep) {
+    constexpr std::size_t kLanes = 70;          // one full vector block plus a partial one
+
+    auto sameState = [](const Chip8::State& a, const Chip8::State& b) {
+        return a.V == b.V && a.pc == b.pc && a.index == b.index && a.sp == b.sp && a.delayTimer == b.delayTimer
+            && a.soundTimer == b.soundTimer && a.key == b.key && a.frameCycles == b.frameCycles
+            && a.cycles == b.cycles && a.rng == b.rng && a.stack == b.stack && a.memory == b.memory
+            && a.display == b.display;
+    };
+
+    for (const char* name : { "Maze.ch8", "Pong.ch8", "Tetris.ch8", "chip8-test-suite-4.2/4-flags.ch8" }) {
+        const std::string path = std::string(CHIP8_ROM_DIR) + "/" + name;
+        std::ifstream file(path, std::ios::binary);
+        std::vector<std::uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        // pairs of lanes share a seed, so some stay together however the rest split up
+        std::vector<std::uint64_t> seeds(kLanes);
+        std::vector<std::unique_ptr<Chip8>> scalar(kLanes);
+        for (std::size_t lane = 0; lane < kLanes; ++lane) {
+            seeds[lane] = lane / 2;
+            scalar[lane] = std::make_unique<Chip8>();
+            ASSERT_TRUE(scalar[lane]->loadROM(rom.data(), rom.size(), seeds[lane]));
+        }
+
+        Lockstep lockstep(kLanes);
+        ASSERT_TRUE(lockstep.loadROM(rom.data(), rom.size(), seeds));
+        EXPECT_EQ(lockstep.grouped(), kLanes);
+
+        std::uint64_t executed = 0, expected = 0;
+        for (int frame = 0; frame < 180; ++frame) {
+            // every fourth pair taps a key for a few frames
+            for (std::size_t lane = 0; lane < kLanes; lane += 8) {
+                if (frame == 60 || frame == 64) {
+                    lockstep.setKey(lane, lane % 16, frame == 60);
+                    scalar[lane]->setKey(lane % 16, frame == 60);
+                }
+            }
+
+            executed += lockstep.runUntilFrame();
+            for (auto& chip8 : scalar)
+                expected += chip8->runUntilFrame(UINT64_MAX);
+        }
+
+        for (std::size_t lane = 0; lane < kLanes; ++lane) {
+            Chip8::State state;
+            lockstep.saveState(lane, state);
+            ASSERT_TRUE(sameState(state, scalar[lane]->state())) << name << " lane " << lane;
+            EXPECT_EQ(lockstep.faulted(lane), scalar[lane]->faulted());
+        }
+        EXPECT_EQ(executed, expected) << name;
+
+        GTCOUT << name << ": " << lockstep.grouped() << " of " << kLanes << " lanes still in lockstep";
+    }
+
+    GTCOUT << "SKP with V0 = 0x1F checks key F in every lane, so none has to leave the group";
+    const std::vector<std::uint8_t> rom = {
+        0x60, 0x1F,                         // 0x200 : LD V0, 0x1F
+        0xE0, 0x9E,                         // 0x202 : SKP V0
+        0x71, 0x01,                         // 0x204 : ADD V1, 1
+        0x12, 0x06,                         // 0x206 : JP 0x206
+    };
+    std::vector<std::uint64_t> seeds(kLanes, 0);
+    Lockstep lockstep(kLanes);
+    ASSERT_TRUE(lockstep.loadROM(rom.data(), rom.size(), seeds));
+    for (std::size_t lane = 0; lane < kLanes; ++lane)
+        lockstep.setKey(lane, 0xF, true);
+    lockstep.runUntilFrame();
+
+    EXPECT_EQ(lockstep.grouped(), kLanes);
+    for (std::size_t lane = 0; lane < kLanes; ++lane) {
+        Chip8::State state;
+        lockstep.saveState(lane, state);
+        EXPECT_EQ(state.V[1], 0) << "lane " << lane;
     }
 }
 